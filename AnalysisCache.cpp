@@ -0,0 +1,162 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * AnalysisCache -
+ * Content-hash-keyed cache of batch analysis results, with a second
+ * level holding the per-frame partials selected by the Dissonance front
+ * end so that changes to the dissonance model constants only re-run the
+ * final (pairwise sum) stage.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "AnalysisCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using std::string;
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static uint64_t
+fnv1a(uint64_t hash, const void *data, size_t n)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < n; ++i) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t
+fnv1a(uint64_t hash, uint64_t value)
+{
+    return fnv1a(hash, &value, sizeof(value));
+}
+
+static uint64_t
+fnv1a(uint64_t hash, float value)
+{
+    return fnv1a(hash, &value, sizeof(value));
+}
+
+static string
+hex(uint64_t value)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+    return buf;
+}
+
+uint64_t
+AnalysisKey::frontEndHash() const
+{
+    uint64_t h = FNV_OFFSET;
+    h = fnv1a(h, audioHash);
+    // headerless input takes these from the command line, not the file
+    h = fnv1a(h, sampleRate);
+    h = fnv1a(h, uint64_t(channels));
+    h = fnv1a(h, uint64_t(stepSize));
+    h = fnv1a(h, uint64_t(blockSize));
+    h = fnv1a(h, uint64_t(pluginVersion));
+    h = fnv1a(h, uint64_t(Dissonance::MaxPartials));
+    return h;
+}
+
+uint64_t
+AnalysisKey::resultHash() const
+{
+    uint64_t h = frontEndHash();
+    h = fnv1a(h, model.b1);
+    h = fnv1a(h, model.b2);
+    h = fnv1a(h, model.s1);
+    h = fnv1a(h, model.s2);
+    h = fnv1a(h, model.c1);
+    h = fnv1a(h, model.c2);
+    h = fnv1a(h, model.Dstar);
+    h = fnv1a(h, model.pruning);
+    return h;
+}
+
+AnalysisCache::AnalysisCache(string directory) :
+    m_directory(directory)
+{
+}
+
+bool
+AnalysisCache::hashFile(string path, uint64_t &hash)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        perror(path.c_str());
+        return false;
+    }
+    unsigned char buf[65536];
+    size_t n;
+    hash = FNV_OFFSET;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        hash = fnv1a(hash, buf, n);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+string
+AnalysisCache::getResultPath(const AnalysisKey &key) const
+{
+    return m_directory + "/" + hex(key.audioHash) + "-" + hex(key.resultHash()) + ".bfeat";
+}
+
+string
+AnalysisCache::getPartialsPath(const AnalysisKey &key) const
+{
+    return m_directory + "/" + hex(key.audioHash) + "-" + hex(key.frontEndHash()) + ".partials.bfeat";
+}
+
+bool
+AnalysisCache::store(const FeatureFileWriter &writer, string path)
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp.%d", int(getpid()));
+    string tmp = path + suffix;
+    if (!writer.write(tmp)) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        perror(path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool
+AnalysisCache::fetch(string path, string dest)
+{
+    FILE *in = fopen(path.c_str(), "rb");
+    if (!in) return false;
+    FILE *out = fopen(dest.c_str(), "wb");
+    if (!out) {
+        perror(dest.c_str());
+        fclose(in);
+        return false;
+    }
+    char buf[65536];
+    size_t n;
+    bool ok = true;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        ok = (fwrite(buf, 1, n, out) == n);
+    }
+    if (ferror(in)) ok = false;
+    fclose(in);
+    if (fclose(out) != 0) ok = false;
+    return ok;
+}
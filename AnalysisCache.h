@@ -0,0 +1,78 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * AnalysisCache -
+ * Content-hash-keyed cache of batch analysis results, with a second
+ * level holding the per-frame partials selected by the Dissonance front
+ * end so that changes to the dissonance model constants only re-run the
+ * final (pairwise sum) stage.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_ANALYSIS_CACHE_H_
+#define _BREGMAN_ANALYSIS_CACHE_H_
+
+#include "Dissonance.h"
+#include "FeatureFile.h"
+
+#include <stdint.h>
+#include <string>
+
+/* Output identifiers of a partials sidecar file */
+#define PARTIALS_COUNT_OUTPUT "partialcount"
+#define PARTIALS_FREQ_OUTPUT "partialfreqs"
+#define PARTIALS_MAG_OUTPUT "partialmags"
+
+/**
+ * Everything that determines the result of analysing one audio file.
+ * The front-end key (audio, sample rate and channels as read, step,
+ * block, plugin version) identifies the partials; the result key adds
+ * the dissonance model.
+ */
+
+struct AnalysisKey
+{
+    AnalysisKey() : audioHash(0), sampleRate(0), channels(0),
+                    stepSize(0), blockSize(0), pluginVersion(0) { }
+
+    uint64_t audioHash;
+    float sampleRate;           /* as read, or as given for raw input */
+    int channels;
+    size_t stepSize;
+    size_t blockSize;
+    int pluginVersion;
+    DissonanceModel model;
+
+    uint64_t frontEndHash() const;
+    uint64_t resultHash() const;
+};
+
+class AnalysisCache
+{
+public:
+    AnalysisCache(std::string directory);
+
+    /** 64-bit FNV-1a hash of the complete contents of a file. */
+    static bool hashFile(std::string path, uint64_t &hash);
+
+    std::string getResultPath(const AnalysisKey &key) const;
+    std::string getPartialsPath(const AnalysisKey &key) const;
+
+    /**
+     * Write a feature file into the cache.  The file is written under
+     * a temporary name and renamed into place, so concurrent batch runs
+     * sharing a cache never observe a partial file.
+     */
+    static bool store(const FeatureFileWriter &writer, std::string path);
+
+    /** Copy a cached file to dest. */
+    static bool fetch(std::string path, std::string dest);
+
+protected:
+    std::string m_directory;
+};
+
+#endif
@@ -0,0 +1,433 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * AudioFile -
+ * Audio input for the batch tools.  Uncompressed WAV, AIFF and raw
+ * float files are mmap()ed and frame windows are mixed down straight
+ * from the mapping; anything else is decoded through libsndfile.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "AudioFile.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::string;
+
+/* Frames decoded per sf_readf_float() call on the libsndfile path */
+#define SNDFILE_READ_FRAMES 4096
+
+static uint32_t
+le16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t
+le32(const unsigned char *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24); }
+
+static uint32_t
+be16(const unsigned char *p) { return (p[0] << 8) | p[1]; }
+
+static uint32_t
+be32(const unsigned char *p) { return (uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+static bool
+hostIsLittleEndian()
+{
+    const uint16_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+/*
+ * Sample decoders.  The integer scale factors are libsndfile's, so
+ * mapped and decoded reads of the same file give identical floats.
+ */
+
+struct DecodeInt16LE {
+    enum { Bytes = 2 };
+    static float at(const unsigned char *p) { return int16_t(le16(p)) * (1.0f / 0x8000); }
+};
+struct DecodeInt16BE {
+    enum { Bytes = 2 };
+    static float at(const unsigned char *p) { return int16_t(be16(p)) * (1.0f / 0x8000); }
+};
+struct DecodeInt24LE {
+    enum { Bytes = 3 };
+    static float at(const unsigned char *p) {
+        return float(int32_t((p[0] << 8) | (p[1] << 16) | (uint32_t(p[2]) << 24)))
+            * (1.0f / 0x80000000U);
+    }
+};
+struct DecodeInt24BE {
+    enum { Bytes = 3 };
+    static float at(const unsigned char *p) {
+        return float(int32_t((uint32_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8)))
+            * (1.0f / 0x80000000U);
+    }
+};
+struct DecodeInt32LE {
+    enum { Bytes = 4 };
+    static float at(const unsigned char *p) { return float(int32_t(le32(p))) * (1.0f / 0x80000000U); }
+};
+struct DecodeInt32BE {
+    enum { Bytes = 4 };
+    static float at(const unsigned char *p) { return float(int32_t(be32(p))) * (1.0f / 0x80000000U); }
+};
+struct DecodeFloat32LE {
+    enum { Bytes = 4 };
+    static float at(const unsigned char *p) {
+        uint32_t u = le32(p);
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+};
+struct DecodeFloat32BE {
+    enum { Bytes = 4 };
+    static float at(const unsigned char *p) {
+        uint32_t u = be32(p);
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+};
+
+/* Average the channels of count frames, as the batch tools always have */
+template <typename Decode>
+static void
+mixDown(const unsigned char *p, int channels, size_t count, float *out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        float sum = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            sum += Decode::at(p);
+            p += Decode::Bytes;
+        }
+        out[i] = sum / channels;
+    }
+}
+
+AudioFile::AudioFile() :
+    m_base(0),
+    m_size(0),
+    m_data(0),
+    m_encoding(Int16LE),
+    m_frameBytes(0),
+    m_sndfile(0),
+    m_readPos(0),
+    m_bufferStart(0),
+    m_bufferFrames(0),
+    m_sampleRate(0),
+    m_channels(0),
+    m_frameCount(0)
+{
+}
+
+AudioFile::~AudioFile()
+{
+    close();
+}
+
+bool
+AudioFile::open(string path, int rawSampleRate, int rawChannels)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_error = "cannot open \"" + path + "\": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        if (rawSampleRate) {
+            m_error = "\"" + path + "\" is empty";
+            return false;
+        }
+        return openSndfile(path);
+    }
+    void *base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        if (rawSampleRate) {
+            m_error = "cannot map \"" + path + "\": " + strerror(errno);
+            return false;
+        }
+        return openSndfile(path);
+    }
+    m_base = base;
+    m_size = st.st_size;
+
+    const unsigned char *p = (const unsigned char *)m_base;
+    bool parsed;
+    if (rawSampleRate) {
+        m_sampleRate = rawSampleRate;
+        m_channels = rawChannels;
+        m_encoding = Float32LE;
+        m_data = p;
+        m_frameBytes = 4 * m_channels;
+        m_frameCount = m_size / m_frameBytes;
+        parsed = (m_channels > 0);
+    } else if (m_size >= 12 && !memcmp(p, "RIFF", 4) && !memcmp(p + 8, "WAVE", 4)) {
+        parsed = parseWav(p, m_size);
+    } else if (m_size >= 12 && !memcmp(p, "FORM", 4) &&
+               (!memcmp(p + 8, "AIFF", 4) || !memcmp(p + 8, "AIFC", 4))) {
+        parsed = parseAiff(p, m_size);
+    } else {
+        parsed = false;
+    }
+
+    if (!parsed) {
+        close();
+        if (rawSampleRate) {
+            m_error = "bad channel count for raw file \"" + path + "\"";
+            return false;
+        }
+        // compressed, 8-bit, RF64 and so on
+        return openSndfile(path);
+    }
+
+    // Windows are read front to back, each chunk of a file from its own
+    // AudioFile, so ask for aggressive read-ahead
+    madvise(m_base, m_size, MADV_SEQUENTIAL);
+
+    m_error = "";
+    return true;
+}
+
+bool
+AudioFile::parseWav(const unsigned char *p, size_t size)
+{
+    size_t pos = 12;
+    int format = 0, bits = 0;
+    size_t blockAlign = 0;
+    bool haveFormat = false;
+
+    while (pos + 8 <= size) {
+        const unsigned char *chunk = p + pos;
+        size_t chunkSize = le32(chunk + 4);
+        const unsigned char *body = chunk + 8;
+        size_t avail = size - pos - 8;
+
+        if (!memcmp(chunk, "fmt ", 4) && chunkSize >= 16 && avail >= 16) {
+            format = le16(body);
+            m_channels = le16(body + 2);
+            m_sampleRate = le32(body + 4);
+            blockAlign = le16(body + 12);
+            bits = le16(body + 14);
+            // WAVE_FORMAT_EXTENSIBLE: the format is the head of the GUID
+            if (format == 0xFFFE && chunkSize >= 40 && avail >= 26) {
+                format = le16(body + 24);
+            }
+            haveFormat = true;
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!haveFormat || m_channels <= 0 || m_sampleRate <= 0) return false;
+            if (format == 1 && bits == 16) m_encoding = Int16LE;
+            else if (format == 1 && bits == 24) m_encoding = Int24LE;
+            else if (format == 1 && bits == 32) m_encoding = Int32LE;
+            else if (format == 3 && bits == 32) m_encoding = Float32LE;
+            else return false;
+            m_frameBytes = size_t(m_channels) * (bits / 8);
+            if (blockAlign != m_frameBytes) return false;
+            m_data = body;
+            // writers that never finished (or are still writing) leave
+            // the size field too large
+            m_frameCount = std::min(chunkSize, avail) / m_frameBytes;
+            return true;
+        }
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+    return false;
+}
+
+bool
+AudioFile::parseAiff(const unsigned char *p, size_t size)
+{
+    bool aifc = !memcmp(p + 8, "AIFC", 4);
+    size_t pos = 12;
+    int bits = 0;
+    bool haveFormat = false;
+
+    while (pos + 8 <= size) {
+        const unsigned char *chunk = p + pos;
+        size_t chunkSize = be32(chunk + 4);
+        const unsigned char *body = chunk + 8;
+        size_t avail = size - pos - 8;
+
+        if (!memcmp(chunk, "COMM", 4) && avail >= 18 + (aifc ? 4 : 0)) {
+            m_channels = be16(body);
+            bits = be16(body + 6);
+            // 80-bit IEEE extended sample rate
+            int exponent = int(be16(body + 8) & 0x7FFF) - 16383 - 63;
+            double mantissa = be32(body + 10) * 4294967296.0 + be32(body + 14);
+            m_sampleRate = int(ldexp(mantissa, exponent) + 0.5);
+
+            const unsigned char *compression = (aifc ? body + 18 : 0);
+            if (!compression || !memcmp(compression, "NONE", 4)) {
+                if (bits == 16) m_encoding = Int16BE;
+                else if (bits == 24) m_encoding = Int24BE;
+                else if (bits == 32) m_encoding = Int32BE;
+                else return false;
+            } else if (!memcmp(compression, "sowt", 4)) {
+                if (bits == 16) m_encoding = Int16LE;
+                else if (bits == 24) m_encoding = Int24LE;
+                else if (bits == 32) m_encoding = Int32LE;
+                else return false;
+            } else if (!memcmp(compression, "fl32", 4) || !memcmp(compression, "FL32", 4)) {
+                m_encoding = Float32BE;
+                bits = 32;
+            } else {
+                return false;
+            }
+            haveFormat = true;
+        } else if (!memcmp(chunk, "SSND", 4) && avail >= 8) {
+            if (!haveFormat || m_channels <= 0 || m_sampleRate <= 0) return false;
+            size_t offset = be32(body);
+            size_t dataSize = std::min(chunkSize, avail);
+            if (dataSize < 8 + offset) return false;
+            m_frameBytes = size_t(m_channels) * (bits / 8);
+            m_data = body + 8 + offset;
+            m_frameCount = (dataSize - 8 - offset) / m_frameBytes;
+            return true;
+        }
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+    return false;
+}
+
+bool
+AudioFile::openSndfile(string path)
+{
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    m_sndfile = sf_open(path.c_str(), SFM_READ, &info);
+    if (!m_sndfile) {
+        m_error = "cannot open \"" + path + "\": " + sf_strerror(0);
+        return false;
+    }
+    m_sampleRate = info.samplerate;
+    m_channels = info.channels;
+    m_frameCount = info.frames;
+    m_readPos = 0;
+    m_bufferFrames = 0;
+    m_interleaved.resize(SNDFILE_READ_FRAMES * m_channels);
+    m_error = "";
+    return true;
+}
+
+void
+AudioFile::close()
+{
+    if (m_base) {
+        munmap(m_base, m_size);
+    }
+    if (m_sndfile) {
+        sf_close(m_sndfile);
+    }
+    m_base = 0;
+    m_size = 0;
+    m_data = 0;
+    m_frameBytes = 0;
+    m_sndfile = 0;
+    m_readPos = 0;
+    m_bufferStart = 0;
+    m_bufferFrames = 0;
+    m_sampleRate = 0;
+    m_channels = 0;
+    m_frameCount = 0;
+}
+
+const float *
+AudioFile::window(size_t start, size_t count)
+{
+    size_t avail = (start < m_frameCount ? std::min(count, m_frameCount - start) : 0);
+
+    if (m_base) {
+        if (m_channels == 1 && avail == count &&
+            m_encoding == (hostIsLittleEndian() ? Float32LE : Float32BE) &&
+            (size_t)m_data % sizeof(float) == 0) {
+            return (const float *)m_data + start;
+        }
+        m_buffer.resize(count);
+        const unsigned char *p = m_data + start * m_frameBytes;
+        float *out = &m_buffer[0];
+        switch (m_encoding) {
+        case Int16LE: mixDown<DecodeInt16LE>(p, m_channels, avail, out); break;
+        case Int16BE: mixDown<DecodeInt16BE>(p, m_channels, avail, out); break;
+        case Int24LE: mixDown<DecodeInt24LE>(p, m_channels, avail, out); break;
+        case Int24BE: mixDown<DecodeInt24BE>(p, m_channels, avail, out); break;
+        case Int32LE: mixDown<DecodeInt32LE>(p, m_channels, avail, out); break;
+        case Int32BE: mixDown<DecodeInt32BE>(p, m_channels, avail, out); break;
+        case Float32LE: mixDown<DecodeFloat32LE>(p, m_channels, avail, out); break;
+        case Float32BE: mixDown<DecodeFloat32BE>(p, m_channels, avail, out); break;
+        }
+        std::fill(out + avail, out + count, 0.0f);
+        return out;
+    }
+
+    if (!m_sndfile) return 0;
+
+    // Keep whatever the previous window shares with this one and decode
+    // only the rest
+    size_t keep = 0;
+    if (m_bufferFrames == count && start >= m_bufferStart &&
+        start < m_bufferStart + count) {
+        keep = m_bufferStart + count - start;
+        memmove(&m_buffer[0], &m_buffer[count - keep], keep * sizeof(float));
+    }
+    m_buffer.resize(count);
+    m_bufferStart = start;
+    m_bufferFrames = count;
+
+    size_t from = start + keep;
+    if (from != m_readPos && from < m_frameCount) {
+        if (sf_seek(m_sndfile, from, SEEK_SET) < 0) {
+            m_readPos = m_frameCount;
+        } else {
+            m_readPos = from;
+        }
+    }
+    if (from == m_readPos) {
+        readSndfile(&m_buffer[keep], count - keep);
+    } else {
+        std::fill(m_buffer.begin() + keep, m_buffer.end(), 0.0f);
+    }
+    return &m_buffer[0];
+}
+
+/*
+ * Read up to count frames from the current position and mix them down
+ * into out, zero filling past the end of the file.
+ */
+void
+AudioFile::readSndfile(float *out, size_t count)
+{
+    size_t done = 0;
+    while (done < count) {
+        sf_count_t got = sf_readf_float(m_sndfile, &m_interleaved[0],
+                                        std::min(count - done, size_t(SNDFILE_READ_FRAMES)));
+        if (got <= 0) break;
+        for (sf_count_t i = 0; i < got; ++i) {
+            float sum = 0.0f;
+            for (int c = 0; c < m_channels; ++c) {
+                sum += m_interleaved[i * m_channels + c];
+            }
+            out[done + i] = sum / m_channels;
+        }
+        done += got;
+    }
+    m_readPos += done;
+    for (size_t i = done; i < count; ++i) out[i] = 0.0f;
+}
@@ -0,0 +1,93 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * AudioFile -
+ * Audio input for the batch tools.  Uncompressed WAV, AIFF and raw
+ * float files are mmap()ed and frame windows are mixed down straight
+ * from the mapping; anything else is decoded through libsndfile.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_AUDIO_FILE_H_
+#define _BREGMAN_AUDIO_FILE_H_
+
+#include <sndfile.h>
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only audio file delivering mono (channel average) windows of
+ * samples, scaled as libsndfile's sf_readf_float() would scale them.
+ */
+
+class AudioFile
+{
+public:
+    AudioFile();
+    virtual ~AudioFile();
+
+    /**
+     * Open path.  If rawSampleRate is non-zero the file is taken to be
+     * headerless little-endian float32 with rawChannels interleaved
+     * channels, and is always mapped.
+     */
+    bool open(std::string path, int rawSampleRate = 0, int rawChannels = 1);
+    void close();
+    bool isOpen() const { return m_base != 0 || m_sndfile != 0; }
+    std::string getError() const { return m_error; }
+
+    /** True if samples are read from a mapping rather than libsndfile. */
+    bool isMapped() const { return m_base != 0; }
+
+    int getSampleRate() const { return m_sampleRate; }
+    int getChannels() const { return m_channels; }
+    size_t getFrameCount() const { return m_frameCount; }
+
+    /**
+     * Mono mixdown of the count frames starting at start, zero filled
+     * past the end of the file.  Mono native float files are returned
+     * in place; otherwise the samples are converted into an internal
+     * buffer, valid until the next call.  Windows that advance through
+     * the file by less than count reuse the overlap when decoding
+     * through libsndfile.
+     */
+    const float *window(size_t start, size_t count);
+
+    enum Encoding {
+        Int16LE, Int16BE, Int24LE, Int24BE, Int32LE, Int32BE,
+        Float32LE, Float32BE
+    };
+
+protected:
+    bool parseWav(const unsigned char *p, size_t size);
+    bool parseAiff(const unsigned char *p, size_t size);
+    bool openSndfile(std::string path);
+    void readSndfile(float *out, size_t count);
+
+    // Mapped files
+    void *m_base;
+    size_t m_size;
+    const unsigned char *m_data;      // first sample frame
+    Encoding m_encoding;
+    size_t m_frameBytes;
+
+    // Everything else
+    SNDFILE *m_sndfile;
+    size_t m_readPos;                 // libsndfile's read position in frames
+    size_t m_bufferStart;             // first frame held in m_buffer
+    size_t m_bufferFrames;            // frames held in m_buffer, 0 if none
+    std::vector<float> m_interleaved;
+
+    int m_sampleRate;
+    int m_channels;
+    size_t m_frameCount;
+    std::vector<float> m_buffer;
+    std::string m_error;
+};
+
+#endif
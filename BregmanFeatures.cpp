@@ -0,0 +1,390 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * BregmanFeatures -
+ * Vamp plugins for spectral centroid, flux, roughness and chroma, and a
+ * combined plugin that computes these and the dissonance together from
+ * one pass of the shared spectral front end.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "BregmanFeatures.h"
+#include "Dissonance.h"
+#include "DenormalGuard.h"
+
+#include <algorithm>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+#include <math.h>
+
+#ifdef __SUNPRO_CC
+#include <ieeefp.h>
+#define isinf(x) (!finite(x))
+#endif
+
+#ifdef WIN32
+#define isnan(x) false
+#define isinf(x) false
+#endif
+
+static const char *chromaNames[12] =
+    { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+BregmanFeatures::BregmanFeatures(float inputSampleRate, int features) :
+    Plugin(inputSampleRate),
+    m_features(features & AllFeatures),
+    m_stepSize(0),
+    m_blockSize(0),
+    m_minFreq(0.0f),
+    m_maxFreq(MAX_ANALYSIS_FREQ),
+    m_havePrev(false)
+{
+}
+
+BregmanFeatures::~BregmanFeatures()
+{
+}
+
+string
+BregmanFeatures::getIdentifier() const
+{
+    switch (m_features) {
+    case CentroidFeature: return "spectralcentroid";
+    case FluxFeature: return "spectralflux";
+    case RoughnessFeature: return "roughness";
+    case ChromaFeature: return "chroma";
+    default: return "bregmanfeatures";
+    }
+}
+
+string
+BregmanFeatures::getName() const
+{
+    switch (m_features) {
+    case CentroidFeature: return "Spectral Centroid";
+    case FluxFeature: return "Spectral Flux";
+    case RoughnessFeature: return "Roughness";
+    case ChromaFeature: return "Chroma";
+    default: return "Bregman Features";
+    }
+}
+
+string
+BregmanFeatures::getDescription() const
+{
+    switch (m_features) {
+    case CentroidFeature: return "Calculate the magnitude-weighted mean frequency of the spectrum of the input signal";
+    case FluxFeature: return "Calculate the increase in spectral magnitude from each block of the input signal to the next";
+    case RoughnessFeature: return "Calculate the roughness of the spectral peaks of the input signal";
+    case ChromaFeature: return "Calculate the spectral energy of the input signal in each of the twelve pitch classes";
+    default: return "Calculate the spectral centroid, flux, roughness, chroma and dissonance of the input signal in one pass";
+    }
+}
+
+string
+BregmanFeatures::getMaker() const
+{
+    return "Bregman Media Labs";
+}
+
+int
+BregmanFeatures::getPluginVersion() const
+{
+    return 1;
+}
+
+string
+BregmanFeatures::getCopyright() const
+{
+    return "Freely redistributable (BSD license)";
+}
+
+size_t
+BregmanFeatures::getPreferredStepSize() const {
+    return 2048;
+}
+
+size_t
+BregmanFeatures::getPreferredBlockSize() const {
+    return 8192;
+}
+
+bool
+BregmanFeatures::initialise(size_t channels, size_t stepSize, size_t blockSize)
+{
+    if (channels < getMinChannelCount() ||
+	channels > getMaxChannelCount()) return false;
+
+    m_stepSize = stepSize;
+    m_blockSize = blockSize;
+    m_frontEnd.initialise(m_inputSampleRate, m_blockSize, m_minFreq, m_maxFreq);
+
+    reset();
+    return true;
+}
+
+void
+BregmanFeatures::reset()
+{
+    m_partials.clear();
+    m_prevMags.assign(m_blockSize/2 + 1, 0.0f);
+    m_havePrev = false;
+    m_frontEnd.resetDenormalFrameCount();
+}
+
+BregmanFeatures::ParameterList
+BregmanFeatures::getParameterDescriptors() const
+{
+    ParameterList list;
+
+    ParameterDescriptor d;
+    d.identifier = "minfreq";
+    d.name = "Minimum Frequency";
+    d.description = "Lowest frequency analysed";
+    d.unit = "Hz";
+    d.minValue = 0;
+    d.maxValue = MAX_ANALYSIS_FREQ;
+    d.defaultValue = 0;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    d.identifier = "maxfreq";
+    d.name = "Maximum Frequency";
+    d.description = "Highest frequency analysed";
+    d.unit = "Hz";
+    d.minValue = 0;
+    d.maxValue = MAX_ANALYSIS_FREQ;
+    d.defaultValue = MAX_ANALYSIS_FREQ;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    return list;
+}
+
+float
+BregmanFeatures::getParameter(string id) const
+{
+    if (id == "minfreq") return m_minFreq;
+    if (id == "maxfreq") return m_maxFreq;
+    return 0.0f;
+}
+
+void
+BregmanFeatures::setParameter(string id, float value)
+{
+    if (id == "minfreq") {
+        m_minFreq = std::max(0.0f, std::min(MAX_ANALYSIS_FREQ, value));
+    } else if (id == "maxfreq") {
+        m_maxFreq = std::max(0.0f, std::min(MAX_ANALYSIS_FREQ, value));
+    }
+}
+
+BregmanFeatures::OutputList
+BregmanFeatures::getOutputDescriptors() const
+{
+    OutputList list;
+
+    OutputDescriptor d;
+    d.hasFixedBinCount = true;
+    d.binCount = 1;
+    d.hasKnownExtents = false;
+    d.isQuantized = false;
+    d.sampleType = OutputDescriptor::OneSamplePerStep;
+
+    if (m_features & CentroidFeature) {
+        d.identifier = "centroid";
+        d.name = "Spectral Centroid";
+        d.description = "Magnitude-weighted mean frequency of the spectrum";
+        d.unit = "Hz";
+        list.push_back(d);
+    }
+
+    if (m_features & FluxFeature) {
+        d.identifier = "flux";
+        d.name = "Spectral Flux";
+        d.description = "Euclidean norm of the increases in bin magnitude since the previous block";
+        d.unit = "";
+        list.push_back(d);
+    }
+
+    if (m_features & RoughnessFeature) {
+        d.identifier = "roughness";
+        d.name = "Roughness";
+        d.description = "Roughness of the strongest spectral peaks (Vassilakis model)";
+        d.unit = "";
+        list.push_back(d);
+    }
+
+    if (m_features & ChromaFeature) {
+        d.identifier = "chroma";
+        d.name = "Chroma";
+        d.description = "Spectral energy in each pitch class, normalised to a maximum of 1";
+        d.unit = "";
+        d.binCount = 12;
+        for (int i = 0; i < 12; ++i) d.binNames.push_back(chromaNames[i]);
+        d.hasKnownExtents = true;
+        d.minValue = 0;
+        d.maxValue = 1;
+        list.push_back(d);
+        d.binCount = 1;
+        d.binNames.clear();
+        d.hasKnownExtents = false;
+    }
+
+    if (m_features & DissonanceFeature) {
+        d.identifier = "dissonance";
+        d.name = "Dissonance";
+        d.description = "Dissonance function of the linear frequency spectrum";
+        d.unit = "Diss";
+        list.push_back(d);
+    }
+
+    return list;
+}
+
+BregmanFeatures::FeatureSet
+BregmanFeatures::process(const float *const *inputBuffers, Vamp::RealTime)
+{
+    if (m_stepSize == 0) {
+	cerr << "ERROR: BregmanFeatures::process: "
+	     << "BregmanFeatures has not been initialised"
+	     << endl;
+	return FeatureSet();
+    }
+
+    DenormalGuard guard;
+    m_frontEnd.analyse(inputBuffers[0], m_frame);
+    if (m_features & (RoughnessFeature | DissonanceFeature)) {
+        size_t npeaks = m_frontEnd.findPeaks(m_frame);
+        m_frontEnd.selectPartials(m_frontEnd.getPeakBins(), m_frontEnd.getPeakMags(),
+                                  npeaks, Dissonance::MaxPartials, m_partials);
+    }
+
+    FeatureSet returnFeatures;
+    int output = 0;
+    Feature feature;
+    feature.hasTimestamp = false;
+
+    if (m_features & CentroidFeature) {
+        feature.values.clear();
+        float value = centroid();
+        if (!isnan(value) && !isinf(value)) feature.values.push_back(value);
+        returnFeatures[output++].push_back(feature);
+    }
+
+    if (m_features & FluxFeature) {
+        feature.values.clear();
+        feature.values.push_back(flux());
+        returnFeatures[output++].push_back(feature);
+    }
+
+    if (m_features & RoughnessFeature) {
+        feature.values.clear();
+        float value = roughness(m_partials);
+        if (!isnan(value) && !isinf(value)) feature.values.push_back(value);
+        returnFeatures[output++].push_back(feature);
+    }
+
+    if (m_features & ChromaFeature) {
+        chroma(feature.values);
+        returnFeatures[output++].push_back(feature);
+    }
+
+    if (m_features & DissonanceFeature) {
+        feature.values.clear();
+        float value = Dissonance::dissonance(m_partials, DissonanceModel());
+        if (!isnan(value) && !isinf(value)) feature.values.push_back(value);
+        returnFeatures[output++].push_back(feature);
+    }
+
+    return returnFeatures;
+}
+
+/*
+ * Mean frequency of bins getLoBin()..getHiBin(), weighted by magnitude.
+ * NaN for a silent frame, which process() reports as no value.
+ */
+float
+BregmanFeatures::centroid() const
+{
+    const vector<float> &mags = m_frame.mags;
+    double num = 0.0, den = 0.0;
+    for (size_t i = m_frontEnd.getLoBin(); i <= m_frontEnd.getHiBin(); ++i) {
+        num += double(i) * mags[i];
+        den += mags[i];
+    }
+    return m_frontEnd.getBinFrequency(1) * (num / den);
+}
+
+/*
+ * L2 norm of the half-wave rectified difference between this frame's
+ * magnitudes and the previous frame's, over getLoBin()..getHiBin().
+ * 0 for the first frame.
+ */
+float
+BregmanFeatures::flux()
+{
+    const vector<float> &mags = m_frame.mags;
+    double sum = 0.0;
+    for (size_t i = m_frontEnd.getLoBin(); i <= m_frontEnd.getHiBin(); ++i) {
+        float d = mags[i] - m_prevMags[i];
+        if (d > 0.0f) sum += d * d;
+        m_prevMags[i] = mags[i];
+    }
+    if (!m_havePrev) {
+        m_havePrev = true;
+        return 0.0f;
+    }
+    return sqrt(sum);
+}
+
+void
+BregmanFeatures::chroma(vector<float> &values) const
+{
+    const vector<float> &mags = m_frame.mags;
+    const vector<int> &chromaBins = m_frontEnd.getTables()->chromaBins;
+    values.assign(12, 0.0f);
+    for (size_t i = m_frontEnd.getLoBin(); i <= m_frontEnd.getHiBin(); ++i) {
+        int c = chromaBins[i];
+        if (c >= 0) values[c] += mags[i] * mags[i];
+    }
+    float peak = *std::max_element(values.begin(), values.end());
+    if (peak > 0.0f) {
+        for (int c = 0; c < 12; ++c) values[c] /= peak;
+    }
+}
+
+float
+BregmanFeatures::roughness(const vector<FreqSortPair> &freqs_mags)
+{
+    // Vassilakis (2001): the Sethares curve for each pair of partials,
+    // weighted by their product and by their degree of amplitude fluctuation
+    const float b1 = -3.5f, b2 = -5.75f, s1 = 0.0207f, s2 = 18.96f, Dstar = 0.24f;
+    float rough = 0.0f;
+    size_t N = freqs_mags.size();
+    for(size_t i = 1; i<N; ++i){
+        for(size_t j = 0; j < N-i ; ++j){
+            float A1 = freqs_mags[j].second, A2 = freqs_mags[j+i].second;
+            if (A1 + A2 <= 0.0f) continue;
+            float S = Dstar / (s1 * freqs_mags[j].first + s2);
+            float Fdif = freqs_mags[j+i].first - freqs_mags[j].first;
+            float X = pow(A1 * A2, 0.1f);
+            float Y = 0.5f * pow(2.0f * std::min(A1, A2) / (A1 + A2), 3.11f);
+            rough += X * Y * (exp(b1 * S * Fdif) - exp(b2 * S * Fdif));
+        }
+    }
+    return rough;
+}
+
+BregmanFeatures::FeatureSet
+BregmanFeatures::getRemainingFeatures()
+{
+    return FeatureSet();
+}
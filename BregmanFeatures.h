@@ -0,0 +1,126 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * BregmanFeatures -
+ * Vamp plugins for spectral centroid, flux, roughness and chroma, and a
+ * combined plugin that computes these and the dissonance together from
+ * one pass of the shared spectral front end.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_FEATURES_PLUGIN_H_
+#define _BREGMAN_FEATURES_PLUGIN_H_
+
+#include "vamp-sdk/Plugin.h"
+
+#include "SpectralFrontEnd.h"
+
+#include <vector>
+
+/**
+ * Plugin computing any subset of the Bregman spectral features.  The
+ * features share one front-end pass per frame; the peak picking is only
+ * run when a partial-based feature (roughness or dissonance) is asked
+ * for.  The outputs are those of the selected features, in the order of
+ * the FeatureFlag enumeration.
+ */
+
+class BregmanFeatures : public Vamp::Plugin
+{
+public:
+    enum FeatureFlag {
+        CentroidFeature   = 0x01,
+        FluxFeature       = 0x02,
+        RoughnessFeature  = 0x04,
+        ChromaFeature     = 0x08,
+        DissonanceFeature = 0x10,
+        AllFeatures       = 0x1f
+    };
+
+    BregmanFeatures(float inputSampleRate, int features = AllFeatures);
+    virtual ~BregmanFeatures();
+
+    bool initialise(size_t channels, size_t stepSize, size_t blockSize);
+    void reset();
+
+    InputDomain getInputDomain() const { return FrequencyDomain; }
+
+    std::string getIdentifier() const;
+    std::string getName() const;
+    std::string getDescription() const;
+    std::string getMaker() const;
+    int getPluginVersion() const;
+    size_t getPreferredStepSize() const;
+    size_t getPreferredBlockSize() const;
+
+    std::string getCopyright() const;
+
+    ParameterList getParameterDescriptors() const;
+    float getParameter(std::string id) const;
+    void setParameter(std::string id, float value);
+
+    OutputList getOutputDescriptors() const;
+
+    FeatureSet process(const float *const *inputBuffers,
+                       Vamp::RealTime timestamp);
+
+    FeatureSet getRemainingFeatures();
+
+    /**
+     * Roughness of a list of partials sorted by ascending frequency,
+     * after Vassilakis (2001).
+     */
+    static float roughness(const std::vector<FreqSortPair> &partials);
+
+protected:
+    float centroid() const;
+    float flux();
+    void chroma(std::vector<float> &values) const;
+
+    int m_features;
+    size_t m_stepSize;
+    size_t m_blockSize;
+    float m_minFreq;
+    float m_maxFreq;
+
+    SpectralFrontEnd m_frontEnd;
+    SpectralFrame m_frame;
+    std::vector<FreqSortPair> m_partials;
+    std::vector<float> m_prevMags;    // previous frame, for the flux
+    bool m_havePrev;
+};
+
+/* The single-feature plugins */
+
+class SpectralCentroid : public BregmanFeatures
+{
+public:
+    SpectralCentroid(float inputSampleRate) :
+        BregmanFeatures(inputSampleRate, CentroidFeature) { }
+};
+
+class SpectralFlux : public BregmanFeatures
+{
+public:
+    SpectralFlux(float inputSampleRate) :
+        BregmanFeatures(inputSampleRate, FluxFeature) { }
+};
+
+class Roughness : public BregmanFeatures
+{
+public:
+    Roughness(float inputSampleRate) :
+        BregmanFeatures(inputSampleRate, RoughnessFeature) { }
+};
+
+class Chroma : public BregmanFeatures
+{
+public:
+    Chroma(float inputSampleRate) :
+        BregmanFeatures(inputSampleRate, ChromaFeature) { }
+};
+
+#endif
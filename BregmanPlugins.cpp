@@ -39,8 +39,16 @@
 #include "vamp-sdk/PluginAdapter.h"
 
 #include "Dissonance.h"
+#include "BregmanFeatures.h"
+#include "SlidingDissonance.h"
 
 static Vamp::PluginAdapter<Dissonance> dissonanceAdapter;
+static Vamp::PluginAdapter<SpectralCentroid> centroidAdapter;
+static Vamp::PluginAdapter<SpectralFlux> fluxAdapter;
+static Vamp::PluginAdapter<Roughness> roughnessAdapter;
+static Vamp::PluginAdapter<Chroma> chromaAdapter;
+static Vamp::PluginAdapter<BregmanFeatures> featuresAdapter;
+static Vamp::PluginAdapter<SlidingDissonance> slidingDissonanceAdapter;
 
 const VampPluginDescriptor *vampGetPluginDescriptor(unsigned int version,
                                                     unsigned int index)
@@ -49,6 +57,12 @@ const VampPluginDescriptor *vampGetPluginDescriptor(unsigned int version,
 
     switch (index) {
     case  0: return dissonanceAdapter.getDescriptor();
+    case  1: return centroidAdapter.getDescriptor();
+    case  2: return fluxAdapter.getDescriptor();
+    case  3: return roughnessAdapter.getDescriptor();
+    case  4: return chromaAdapter.getDescriptor();
+    case  5: return featuresAdapter.getDescriptor();
+    case  6: return slidingDissonanceAdapter.getDescriptor();
     default: return 0;
     }
 }
@@ -0,0 +1,91 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * DenormalGuard -
+ * Scoped flush-to-zero / denormals-are-zero floating point mode.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_DENORMAL_GUARD_H_
+#define _BREGMAN_DENORMAL_GUARD_H_
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define DENORMAL_GUARD_SSE 1
+#elif defined(__aarch64__)
+#define DENORMAL_GUARD_AARCH64 1
+#endif
+
+/**
+ * While in scope, subnormal results of float arithmetic on the calling
+ * thread are flushed to zero (and, on x86, subnormal operands read as
+ * zero), so that IIR filter tails decaying towards silence do not fall
+ * onto the slow microcoded path.  The previous mode, and the caller's
+ * exception flags, are restored on destruction, so the host is
+ * unaffected.
+ *
+ * flushed() reports whether a subnormal was flushed since construction
+ * or the previous call.  On platforms without a known control register
+ * the guard does nothing and flushed() is always false.
+ */
+
+class DenormalGuard
+{
+public:
+    DenormalGuard() {
+#if defined(DENORMAL_GUARD_SSE)
+        m_saved = _mm_getcsr();
+        // FTZ (bit 15) and DAZ (bit 6) on, sticky exception flags cleared
+        _mm_setcsr((m_saved | 0x8040) & ~FLAGS);
+#elif defined(DENORMAL_GUARD_AARCH64)
+        unsigned long fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        __asm__ __volatile__("mrs %0, fpsr" : "=r"(m_savedStatus));
+        m_saved = fpcr;
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (1UL << 24))); // FZ
+        __asm__ __volatile__("msr fpsr, %0" : : "r"(m_savedStatus & ~FLAGS));
+#endif
+    }
+
+    ~DenormalGuard() {
+#if defined(DENORMAL_GUARD_SSE)
+        _mm_setcsr(m_saved);
+#elif defined(DENORMAL_GUARD_AARCH64)
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(m_saved));
+        __asm__ __volatile__("msr fpsr, %0" : : "r"(m_savedStatus));
+#endif
+    }
+
+    bool flushed() {
+#if defined(DENORMAL_GUARD_SSE)
+        unsigned int csr = _mm_getcsr();
+        _mm_setcsr(csr & ~FLAGS);
+        return (csr & FLAGS) != 0;
+#elif defined(DENORMAL_GUARD_AARCH64)
+        unsigned long fpsr;
+        __asm__ __volatile__("mrs %0, fpsr" : "=r"(fpsr));
+        __asm__ __volatile__("msr fpsr, %0" : : "r"(fpsr & ~FLAGS));
+        return (fpsr & FLAGS) != 0;
+#else
+        return false;
+#endif
+    }
+
+private:
+#if defined(DENORMAL_GUARD_SSE)
+    enum { FLAGS = 0x0012 };    // denormal operand (DE) and underflow (UE)
+    unsigned int m_saved;
+#elif defined(DENORMAL_GUARD_AARCH64)
+    enum { FLAGS = 0x0088 };    // input denormal (IDC) and underflow (UFC)
+    unsigned long m_saved;
+    unsigned long m_savedStatus;
+#endif
+
+    DenormalGuard(const DenormalGuard &);
+    DenormalGuard &operator=(const DenormalGuard &);
+};
+
+#endif
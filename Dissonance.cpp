@@ -11,18 +11,10 @@
  */
 
 #include "Dissonance.h"
+#include "DenormalGuard.h"
+#include "FramePipeline.h"
 #include <algorithm>
 
-typedef std::pair<float, int> IdxSortPair;
-typedef std::pair<float,float> FreqSortPair;
-
-bool IdxComparator ( const IdxSortPair& l, const IdxSortPair& r)
-    { return l.first < r.first; }
-
-bool FreqComparator ( const FreqSortPair& l, const FreqSortPair& r)
-{ return l.first < r.first; }
-
-
 using std::string;
 using std::vector;
 using std::cerr;
@@ -30,6 +22,7 @@ using std::endl;
 
 #include <math.h>
 #include <stdlib.h>
+#include <time.h>
 
 #ifdef __SUNPRO_CC
 #include <ieeefp.h>
@@ -39,47 +32,86 @@ using std::endl;
 #ifdef WIN32
 #define isnan(x) false
 #define isinf(x) false
+#define NOMINMAX
+#include <windows.h>
 #endif
 
-// quick and dirty Butterworth low-pass filter coefficients (from scipy, cutoff = 0.25)
-// b, a
-#define LPF_ORDER 11
-float lpf_coeffs[2][LPF_ORDER] = 
-    {{1.10559099e-05,   1.10559099e-04,   4.97515946e-04,
-          1.32670919e-03,   2.32174108e-03,   2.78608930e-03,
-          2.32174108e-03,   1.32670919e-03,   4.97515946e-04,
-          1.10559099e-04,   1.10559099e-05},
-    {1.00000000e+00,  -4.98698526e+00,   1.19364368e+01,
-         -1.77423718e+01,   1.79732280e+01,  -1.28862417e+01,
-         6.59320221e+00,  -2.36909169e+00,   5.70632706e-01,
-         -8.30176785e-02,   5.52971437e-03}};
+// Partial tracking falls back to a full peak scan at least this often,
+// and whenever the spectral energy moves this far from the last full scan
+#define TRACK_RESCAN_INTERVAL 16
+#define TRACK_ENERGY_CHANGE 0.5f
+
+// Largest numpartials parameter value
+#define MAX_PARTIALS_PARAM 4096
+
+// Frames each pipeline worker may hold, and the most workers allowed
+#define PIPELINE_DEPTH 4
+#define MAX_PIPELINE_THREADS 16
+
+// Quality of service: the levels are cumulative, each adding one
+// cheaper analysis to those of the levels below it:
+//   1 halves the number of partials
+//   2 prunes the dissonance sum at QOS_PRUNING critical bands
+//   3 decimates the smoothing by QOS_DECIMATION
+//   4 limits the band searched for peaks to QOS_MAX_FREQ
+// The level steps down once the recent process() time (an exponential
+// average with weight QOS_ALPHA) is over budget, and up once it has
+// fallen below QOS_HEADROOM of the budget; either only after QOS_HOLD
+// frames at the current level, so that the average reflects it
+#define QOS_LEVELS 5
+#define QOS_PRUNING 20.0f
+#define QOS_DECIMATION 2
+#define QOS_MAX_FREQ 4000.0f
+#define QOS_ALPHA 0.25f
+#define QOS_HEADROOM 0.5f
+#define QOS_HOLD 8
+
+static double
+now()
+{
+#ifdef WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return double(count.QuadPart) / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
 
+const size_t Dissonance::MaxPartials;
 
 Dissonance::Dissonance(float inputSampleRate) :
     Plugin(inputSampleRate),
     m_stepSize(0),
-    m_blockSize(0)
+    m_blockSize(0),
+    m_numPartials(MaxPartials),
+    m_decimation(1),
+    m_activePartials(MaxPartials),
+    m_threads(0),
+    m_pipeline(0),
+    m_tracking(false),
+    m_trackWindow(4),
+    m_framesSinceScan(0),
+    m_scanEnergy(0.0f),
+    m_minFreq(0.0f),
+    m_maxFreq(MAX_ANALYSIS_FREQ),
+    m_summary(false),
+    m_summaryPeriod(0.0f),
+    m_segmentOpen(false),
+    m_frameCount(0),
+    m_budget(0.0f),
+    m_qosLevel(0),
+    m_qosLoad(0.0f),
+    m_qosHold(0)
 {
-
-    initialise_filter();
 }
 
 Dissonance::~Dissonance()
 {
-}
-
-void Dissonance::initialise_filter(){
-    lpf = (FILTER*) calloc(1,sizeof(FILTER));
-    lpf->numb = LPF_ORDER;
-    lpf->numa = LPF_ORDER; // Assume A[0]=1 and crop array
-    int i;
-    for(i=0; i<lpf->numb; i++){
-	lpf->coeffs[i] = lpf_coeffs[0][i];
-    }
-    for(i=1; i<lpf->numa; i++){ // Assume A[0]=1 and crop array
-        lpf->coeffs[lpf->numb+i-1] = lpf_coeffs[1][i];
-    }
-    ifilter(lpf);
+    delete m_pipeline;
 }
 
 string
@@ -136,13 +168,220 @@ Dissonance::initialise(size_t channels, size_t stepSize, size_t blockSize)
 
     m_stepSize = stepSize;
     m_blockSize = blockSize;
-    
+
+    m_frontEnd.initialise(m_inputSampleRate, m_blockSize, m_minFreq, m_maxFreq);
+    m_frontEnd.setDecimation(m_decimation);
+    m_frames.resize(SpectralFrontEnd::Lanes);
+
+    reset();
     return true;
 }
 
 void
 Dissonance::reset()
 {
+    m_partials.clear();
+    m_partialBins.clear();
+    m_framesSinceScan = 0;
+    m_scanEnergy = 0.0f;
+    m_trackBins.assign(m_numPartials, 0);
+    m_frontEnd.resetDenormalFrameCount();
+    m_stats.reset();
+    m_segmentOpen = false;
+    m_frameCount = 0;
+    setQosLevel(0);
+    m_qosLoad = 0.0f;
+
+    // frames in flight belong to the old run: start a fresh pipeline
+    delete m_pipeline;
+    m_pipeline = 0;
+    if (m_threads > 0 && m_stepSize > 0) {
+        m_pipeline = new FramePipeline(m_frontEnd, m_threads, PIPELINE_DEPTH);
+        if (!m_pipeline->isRunning()) {
+            cerr << "WARNING: Dissonance::reset: "
+                 << "no worker threads, analysing in process()" << endl;
+            delete m_pipeline;
+            m_pipeline = 0;
+        }
+    }
+}
+
+size_t
+Dissonance::getDenormalFrameCount() const
+{
+    return m_frontEnd.getDenormalFrameCount() +
+        (m_pipeline ? m_pipeline->getDenormalFrameCount() : 0);
+}
+
+Dissonance::ParameterList
+Dissonance::getParameterDescriptors() const
+{
+    ParameterList list;
+
+    ParameterDescriptor d;
+    d.identifier = "tracking";
+    d.name = "Partial Tracking";
+    d.description = "Search for peaks near the previous frame's partials first, falling back to a full scan on novelty, and report partial tracks";
+    d.unit = "";
+    d.minValue = 0;
+    d.maxValue = 1;
+    d.defaultValue = 0;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    list.push_back(d);
+
+    d.identifier = "trackwindow";
+    d.name = "Tracking Window";
+    d.description = "Half-width of the peak search around each tracked partial";
+    d.unit = "bins";
+    d.minValue = 1;
+    d.maxValue = 32;
+    d.defaultValue = 4;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    list.push_back(d);
+
+    d.identifier = "minfreq";
+    d.name = "Minimum Frequency";
+    d.description = "Lowest frequency searched for partials";
+    d.unit = "Hz";
+    d.minValue = 0;
+    d.maxValue = MAX_ANALYSIS_FREQ;
+    d.defaultValue = 0;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    d.identifier = "maxfreq";
+    d.name = "Maximum Frequency";
+    d.description = "Highest frequency searched for partials; bins far above it are not analysed at all";
+    d.unit = "Hz";
+    d.minValue = 0;
+    d.maxValue = MAX_ANALYSIS_FREQ;
+    d.defaultValue = MAX_ANALYSIS_FREQ;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    d.identifier = "summary";
+    d.name = "Summary Statistics";
+    d.description = "Accumulate running statistics of the dissonance and report them on the summary output";
+    d.unit = "";
+    d.minValue = 0;
+    d.maxValue = 1;
+    d.defaultValue = 0;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    list.push_back(d);
+
+    d.identifier = "summaryperiod";
+    d.name = "Summary Period";
+    d.description = "Length of the segments summarised, or 0 to summarise the whole input";
+    d.unit = "s";
+    d.minValue = 0;
+    d.maxValue = 3600;
+    d.defaultValue = 0;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    d.identifier = "numpartials";
+    d.name = "Number of Partials";
+    d.description = "Number of the strongest spectral peaks entering the dissonance sum";
+    d.unit = "";
+    d.minValue = 1;
+    d.maxValue = MAX_PARTIALS_PARAM;
+    d.defaultValue = MaxPartials;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    list.push_back(d);
+
+    d.identifier = "pruning";
+    d.name = "Pruning Distance";
+    d.description = "Skip pairs of partials further apart than this many critical bandwidths, or 0 to evaluate every pair";
+    d.unit = "bands";
+    d.minValue = 0;
+    d.maxValue = 100;
+    d.defaultValue = 0;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    d.identifier = "threads";
+    d.name = "Worker Threads";
+    d.description = "Analyse frames on this many threads, returning their features with timestamps from later process() calls, or 0 to analyse each frame within its process() call";
+    d.unit = "";
+    d.minValue = 0;
+    d.maxValue = MAX_PIPELINE_THREADS;
+    d.defaultValue = 0;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    list.push_back(d);
+
+    d.identifier = "budget";
+    d.name = "Time Budget";
+    d.description = "Processing time allowed per block: when recent blocks have taken longer, step down through cheaper analyses (fewer partials, pruned sum, decimated smoothing, narrower band), and back up when there is headroom again, or 0 to always run the full analysis.  Ignored with worker threads";
+    d.unit = "ms";
+    d.minValue = 0;
+    d.maxValue = 1000;
+    d.defaultValue = 0;
+    d.isQuantized = false;
+    list.push_back(d);
+
+    d.identifier = "decimation";
+    d.name = "Smoothing Decimation";
+    d.description = "Compute the smoothed spectrum at every Nth bin, locating peaks on that grid and refining them to the full-resolution bin, or 1 to smooth every bin";
+    d.unit = "";
+    d.minValue = 1;
+    d.maxValue = SpectralFrontEnd::MaxDecimation;
+    d.defaultValue = 1;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    list.push_back(d);
+
+    return list;
+}
+
+float
+Dissonance::getParameter(string id) const
+{
+    if (id == "tracking") return m_tracking ? 1.0f : 0.0f;
+    if (id == "trackwindow") return m_trackWindow;
+    if (id == "minfreq") return m_minFreq;
+    if (id == "maxfreq") return m_maxFreq;
+    if (id == "summary") return m_summary ? 1.0f : 0.0f;
+    if (id == "summaryperiod") return m_summaryPeriod;
+    if (id == "numpartials") return m_numPartials;
+    if (id == "pruning") return m_model.pruning;
+    if (id == "threads") return m_threads;
+    if (id == "decimation") return m_decimation;
+    if (id == "budget") return m_budget;
+    return 0.0f;
+}
+
+void
+Dissonance::setParameter(string id, float value)
+{
+    if (id == "tracking") {
+        m_tracking = (value > 0.5f);
+    } else if (id == "trackwindow") {
+        m_trackWindow = std::max(1, std::min(32, int(value + 0.5f)));
+    } else if (id == "minfreq") {
+        m_minFreq = std::max(0.0f, std::min(MAX_ANALYSIS_FREQ, value));
+    } else if (id == "maxfreq") {
+        m_maxFreq = std::max(0.0f, std::min(MAX_ANALYSIS_FREQ, value));
+    } else if (id == "summary") {
+        m_summary = (value > 0.5f);
+    } else if (id == "summaryperiod") {
+        m_summaryPeriod = std::max(0.0f, std::min(3600.0f, value));
+    } else if (id == "numpartials") {
+        m_numPartials = std::max(1, std::min(MAX_PARTIALS_PARAM, int(value + 0.5f)));
+    } else if (id == "pruning") {
+        m_model.pruning = std::max(0.0f, std::min(100.0f, value));
+    } else if (id == "threads") {
+        m_threads = std::max(0, std::min(MAX_PIPELINE_THREADS, int(value + 0.5f)));
+    } else if (id == "decimation") {
+        m_decimation = std::max(1, std::min(int(SpectralFrontEnd::MaxDecimation),
+                                            int(value + 0.5f)));
+    } else if (id == "budget") {
+        m_budget = std::max(0.0f, std::min(1000.0f, value));
+    }
 }
 
 Dissonance::OutputList
@@ -150,6 +389,15 @@ Dissonance::getOutputDescriptors() const
 {
     OutputList list;
 
+    // Pipelined frames come back from later process() calls, so carry
+    // their own timestamps
+    OutputDescriptor::SampleType frameType = OutputDescriptor::OneSamplePerStep;
+    float frameRate = 0.0f;
+    if (m_threads > 0) {
+        frameType = OutputDescriptor::VariableSampleRate;
+        if (m_stepSize > 0) frameRate = m_inputSampleRate / m_stepSize;
+    }
+
     OutputDescriptor d;
     d.identifier = "lineardissonance";
     d.name = "Dissonance";
@@ -159,7 +407,61 @@ Dissonance::getOutputDescriptors() const
     d.binCount = 1;
     d.hasKnownExtents = false;
     d.isQuantized = false;
-    d.sampleType = OutputDescriptor::OneSamplePerStep;
+    d.sampleType = frameType;
+    d.sampleRate = frameRate;
+    list.push_back(d);
+
+    d.identifier = "partialtracks";
+    d.name = "Partial Tracks";
+    d.description = "Frequency of the partial in each track slot, or 0 if the slot is empty (partial tracking only)";
+    d.unit = "Hz";
+    d.hasFixedBinCount = true;
+    d.binCount = m_numPartials;
+    d.hasKnownExtents = false;
+    d.isQuantized = false;
+    d.sampleType = frameType;
+    d.sampleRate = frameRate;
+    list.push_back(d);
+
+    d.identifier = "summary";
+    d.name = "Dissonance Summary";
+    d.description = "Frame count, mean, variance, minimum, maximum and 10/25/50/75/90% quantiles of the dissonance over each summary period, or over the whole input (summary statistics only)";
+    d.unit = "Diss";
+    d.hasFixedBinCount = true;
+    d.binCount = SummaryStats::ValueCount;
+    d.binNames.clear();
+    d.binNames.push_back("count");
+    d.binNames.push_back("mean");
+    d.binNames.push_back("variance");
+    d.binNames.push_back("min");
+    d.binNames.push_back("max");
+    d.binNames.push_back("p10");
+    d.binNames.push_back("p25");
+    d.binNames.push_back("median");
+    d.binNames.push_back("p75");
+    d.binNames.push_back("p90");
+    d.hasKnownExtents = false;
+    d.isQuantized = false;
+    d.sampleType = OutputDescriptor::VariableSampleRate;
+    d.sampleRate = 0;
+    d.hasDuration = true;
+    list.push_back(d);
+
+    d.identifier = "qoslevel";
+    d.name = "Quality of Service Level";
+    d.description = "Number of cheaper analyses in use for the block, from 0 (full analysis) to 4 (peaks searched for only below 4 kHz)";
+    d.unit = "";
+    d.hasFixedBinCount = true;
+    d.binCount = 1;
+    d.binNames.clear();
+    d.hasKnownExtents = true;
+    d.minValue = 0;
+    d.maxValue = QOS_LEVELS - 1;
+    d.isQuantized = true;
+    d.quantizeStep = 1;
+    d.sampleType = frameType;
+    d.sampleRate = frameRate;
+    d.hasDuration = false;
     list.push_back(d);
 
     //    d.identifier = "logdissonance";
@@ -179,108 +481,311 @@ Dissonance::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
 	     << endl;
 	return FeatureSet();
     }
-    FeatureSet returnFeatures; // output "scale" aggregator
-    Feature feature; // output feature
+    if (m_pipeline) {
+        FeatureSet returnFeatures;
+        // make room by waiting for the oldest frames if need be, then
+        // return whatever else has completed
+        while (m_pipeline->isFull()) collectFrame(returnFeatures, true);
+        m_pipeline->submit(inputBuffers[0], timestamp);
+        while (collectFrame(returnFeatures, false)) ;
+        return returnFeatures;
+    }
+
+    DenormalGuard guard;
+    double start = (m_budget > 0.0f ? now() : 0.0);
+    findPartials(inputBuffers[0], m_partials);
+    FeatureSet returnFeatures = outputFeatures(timestamp);
+    if (m_budget > 0.0f) updateQos(now() - start);
+    return returnFeatures;
+}
+
+/*
+ * Fold one frame's processing time into the recent average, and step
+ * the level down or up as the QOS_ constants describe.
+ */
+void
+Dissonance::updateQos(double seconds)
+{
+    float load = seconds * 1000.0 / m_budget;
+    m_qosLoad += QOS_ALPHA * (load - m_qosLoad);
+    if (++m_qosHold < QOS_HOLD) return;
+    if (m_qosLoad > 1.0f && m_qosLevel + 1 < QOS_LEVELS) {
+        setQosLevel(m_qosLevel + 1);
+    } else if (m_qosLoad < QOS_HEADROOM && m_qosLevel > 0) {
+        setQosLevel(m_qosLevel - 1);
+    }
+}
+
+/*
+ * Configure the analysis for a quality of service level, 0 restoring
+ * the parameters as set.
+ */
+void
+Dissonance::setQosLevel(int level)
+{
+    m_qosLevel = level;
+    m_qosHold = 0;
+    m_activePartials = m_numPartials;
+    if (level >= 1) m_activePartials = std::max(size_t(1), m_numPartials / 2);
+    if (m_stepSize == 0) return;
+    m_frontEnd.setDecimation(level >= 3 ? std::max(m_decimation, size_t(QOS_DECIMATION))
+                             : m_decimation);
+    m_frontEnd.setBand(m_minFreq, level >= 4 ? std::max(m_minFreq, std::min(m_maxFreq, QOS_MAX_FREQ))
+                       : m_maxFreq);
+}
 
-    initialise_filter();
-
-    Feature freqs;
-    Feature mags;
-    freqs.values.push_back(0);
-    mags.values.push_back(0);
-    for (size_t i = 1; i <= m_blockSize/2; ++i) {
-	double freq = (double(i) * m_inputSampleRate) / m_blockSize;
-	double real = inputBuffers[0][i*2];
-	double imag = inputBuffers[0][i*2 + 1];
-	mags.values.push_back(sqrt(real * real + imag * imag) / (m_blockSize/2));
-        freqs.values.push_back(freq);
+/*
+ * Finish the oldest pipelined frame, if it has been analysed (or, if
+ * wait is set, once it has), appending its features.  Peak picking and
+ * the rest run here, in frame order, as they carry state from frame to
+ * frame.  Returns false if there was no frame to finish.
+ */
+bool
+Dissonance::collectFrame(FeatureSet &features, bool wait)
+{
+    Vamp::RealTime timestamp;
+    const SpectralFrame *frame = m_pipeline->next(timestamp, wait);
+    if (!frame) return false;
+    pickPartials(*frame, m_partials);
+    FeatureSet frameFeatures = outputFeatures(timestamp);
+    m_pipeline->release();
+    for (FeatureSet::iterator i = frameFeatures.begin(); i != frameFeatures.end(); ++i) {
+        FeatureList &list = features[i->first];
+        list.insert(list.end(), i->second.begin(), i->second.end());
     }
-    // Low-pass filtering the spectrum: Reversal for backward-forward filtering
-    // backward-forward filtering results in a linear-phase filter
-    Feature rev_mags;
-    for(size_t i = 0; i <= m_blockSize/2; ++i){
-        rev_mags.values.push_back(mags.values[m_blockSize/2-i]);
-    }   
-    Feature rev_outs;
-    rev_outs.values.resize(m_blockSize/2);
-    lpf->in = rev_mags.values.data();
-    lpf->out = rev_outs.values.data();
-    afilter(lpf, m_blockSize/2); // backward filter
-    for(size_t i = 0; i <= m_blockSize/2; ++i){
-        lpf->in[i] = lpf->out[m_blockSize/2-i];        
+    return true;
+}
+
+void
+Dissonance::processFrames(const float *const *spectra, size_t count,
+                          vector<FeatureSet> &features,
+                          vector<vector<FreqSortPair> > *partials)
+{
+    features.clear();
+    if (partials) partials->clear();
+    if (m_stepSize == 0) {
+	cerr << "ERROR: Dissonance::processFrames: "
+	     << "Dissonance has not been initialised"
+	     << endl;
+	return;
     }
-    afilter(lpf, m_blockSize/2); // forward filter
-    // Half-wave rectification
-    for(size_t i = 0; i <= m_blockSize/2; ++i){
-        if(rev_outs.values[i]<0.0f){
-            rev_outs.values[i]=0.0f;     // half-wave rectify
+
+    DenormalGuard guard;
+    for (size_t f = 0; f < count; f += SpectralFrontEnd::Lanes) {
+        size_t n = std::min(count - f, SpectralFrontEnd::Lanes);
+        m_frontEnd.analyse(spectra + f, n, &m_frames[0]);
+        // peak picking carries tracking state, so goes frame by frame
+        for (size_t l = 0; l < n; ++l) {
+            pickPartials(m_frames[l], m_partials);
+            Vamp::RealTime rt = Vamp::RealTime::frame2RealTime
+                (m_frameCount * m_stepSize, (unsigned int)(m_inputSampleRate + 0.5f));
+            features.push_back(outputFeatures(rt));
+            if (partials) partials->push_back(m_partials);
         }
     }
-    // Magnitude derivatives wrt frequency
-    Feature diffs;
-    diffs.values.push_back(0.0f);
-    for(size_t i = 1; i <= m_blockSize/2; ++i){
-        diffs.values.push_back(rev_outs.values[i] - rev_outs.values[i-1]);
+}
+
+Dissonance::FeatureSet
+Dissonance::outputFeatures(Vamp::RealTime timestamp)
+{
+    FeatureSet returnFeatures; // output "scale" aggregator
+    Feature feature; // output feature
+
+    DissonanceModel model = m_model;
+    if (m_qosLevel >= 2 && model.pruning <= 0.0f) model.pruning = QOS_PRUNING;
+    float diss_val = dissonance(m_partials, model);
+
+    feature.hasTimestamp = (m_pipeline != 0);
+    feature.timestamp = timestamp;
+    if (!isnan(diss_val) && !isinf(diss_val)) {
+        feature.values.push_back(diss_val);
     }
+    returnFeatures[0].push_back(feature);
 
-    // Peak finding (spectral derivatives' zero crossings)
-    float thresh = 1e-9f;
-    vector<size_t> peak_idx;
-    for(size_t i = 1; i <= m_blockSize/2; ++i){
-        // zero crossing detector
-        if( (diffs.values[i-1] > thresh) && (diffs.values[i] < -thresh) )
-            peak_idx.push_back(i);
+    if (m_tracking) {
+        updateTracks();
+        Feature tracks;
+        tracks.hasTimestamp = (m_pipeline != 0);
+        tracks.timestamp = timestamp;
+        for (size_t i = 0; i < m_trackBins.size(); ++i) {
+            tracks.values.push_back((float(m_trackBins[i]) * m_inputSampleRate) / m_blockSize);
+        }
+        returnFeatures[1].push_back(tracks);
     }
 
-    if (!peak_idx.size()){ // Abort if no peaks
-        // std::cout << "Dissonance:: Warning: zero-length peak_idx" << endl;
-        feature.hasTimestamp = false;
-        feature.values.push_back(0.0f);
-        returnFeatures[0].push_back(feature);
-        returnFeatures[1].push_back(feature);
-        return returnFeatures;        
+    if (m_summary) {
+        if (m_segmentOpen && m_summaryPeriod > 0.0f &&
+            timestamp - m_segmentStart >= Vamp::RealTime::fromSeconds(m_summaryPeriod)) {
+            if (m_stats.getCount()) returnFeatures[2].push_back(summaryFeature());
+            m_stats.reset();
+            m_segmentOpen = false;
+        }
+        if (!m_segmentOpen) {
+            m_segmentStart = timestamp;
+            m_segmentOpen = true;
+        }
+        if (!feature.values.empty()) m_stats.add(diss_val);
+        m_segmentEnd = timestamp + Vamp::RealTime::frame2RealTime
+            (m_stepSize, (unsigned int)(m_inputSampleRate + 0.5f));
     }
 
-    std::vector<IdxSortPair> arg_idx;
-    for(size_t i = 0; i < peak_idx.size(); ++i){
-        arg_idx.push_back(IdxSortPair(mags.values[peak_idx[i]], peak_idx[i]));
-        // std::cout << "(" << mags.values[peak_idx[i]] << "," << peak_idx[i] << ")" << endl;
+    if (m_budget > 0.0f && !m_pipeline) {
+        Feature level;
+        level.hasTimestamp = false;
+        level.values.push_back(m_qosLevel);
+        returnFeatures[3].push_back(level);
     }
-    // Reverse sorting by magnitude
-    std::sort(arg_idx.rbegin(), arg_idx.rend(), IdxComparator);
-    // Now grab the sorted list of freq, mags as a new pair
-    size_t num_partials = std::min((int)peak_idx.size(),20); // How many partials to use in dissonance function
-    std::vector<FreqSortPair> freqs_mags;
-    for(size_t i = 0; i < num_partials; ++i){
-        freqs_mags.push_back(FreqSortPair(freqs.values[arg_idx[i].second],mags.values[arg_idx[i].second]));
-    }    
-    std::sort(freqs_mags.begin(), freqs_mags.end(), FreqComparator); // sort by freq,mag pairs by ascending frequencies
-    // Finally, compute the dissonance function
-    float b1=-3.51f, b2=-5.75f, s1=0.0207f, s2=19.96f, c1=5.0f, c2=-5.0f, Dstar=0.24f;
-    float diss_val = 0.0f;
-    size_t N = freqs_mags.size();
-    for(size_t i = 1; i<N; ++i){
-        for(size_t j = 0; j < N-i ; ++j){
-            float S = Dstar / (s1 * freqs_mags[j].first + s2 );
-            float Fdif = freqs_mags[j+i].first - freqs_mags[j].first;
-            float am = freqs_mags[j+i].second * freqs_mags[j].second;
-            diss_val += am * ( c1 * exp(b1 * S * Fdif) + c2 * exp(b2 * S * Fdif) );
+
+    ++m_frameCount;
+    return returnFeatures;
+}
+
+/*
+ * The summary statistics of the current segment, stamped with its
+ * start time and duration.
+ */
+Dissonance::Feature
+Dissonance::summaryFeature() const
+{
+    Feature summary;
+    summary.hasTimestamp = true;
+    summary.timestamp = m_segmentStart;
+    summary.hasDuration = true;
+    summary.duration = m_segmentEnd - m_segmentStart;
+    m_stats.getValues(summary.values);
+    return summary;
+}
+
+void
+Dissonance::findPartials(const float *spectrum, vector<FreqSortPair> &freqs_mags)
+{
+    SpectralFrame &frame = m_frames[0];
+    m_frontEnd.analyse(spectrum, frame);
+    pickPartials(frame, freqs_mags);
+}
+
+/*
+ * Peak picking on a smoothed spectrum: the strongest m_activePartials
+ * derivative zero crossings, by unsmoothed magnitude, as partials
+ * sorted by ascending frequency.
+ */
+void
+Dissonance::pickPartials(const SpectralFrame &frame, vector<FreqSortPair> &freqs_mags)
+{
+    vector<size_t> tracked;
+    if (m_tracking && trackPeaks(frame, tracked)) {
+        vector<float> mags;
+        for (size_t i = 0; i < tracked.size(); ++i) {
+            mags.push_back(frame.mags[tracked[i]]);
         }
+        m_frontEnd.selectPartials(tracked.empty() ? 0 : &tracked[0],
+                                  mags.empty() ? 0 : &mags[0], tracked.size(),
+                                  m_activePartials, freqs_mags, &m_partialBins);
+    } else {
+        // Peak finding (spectral derivatives' zero crossings)
+        size_t npeaks = m_frontEnd.findPeaks(frame);
+        m_framesSinceScan = 0;
+        m_scanEnergy = frame.energy;
+        m_frontEnd.selectPartials(m_frontEnd.getPeakBins(), m_frontEnd.getPeakMags(),
+                                  npeaks, m_activePartials, freqs_mags, &m_partialBins);
     }
+}
 
-    feature.hasTimestamp = false;
-    if (!isnan(diss_val) && !isinf(diss_val)) {
-        feature.values.push_back(diss_val);
+/*
+ * Peak search seeded by the previous frame's partials: zero crossings of
+ * the smoothed-spectrum derivative are sought only within m_trackWindow
+ * bins of each partial.  Returns false (leaving peak_idx empty) when the
+ * frame looks novel and a full scan is needed instead.
+ */
+bool
+Dissonance::trackPeaks(const SpectralFrame &frame, vector<size_t> &peak_idx)
+{
+    if (m_partialBins.empty() ||
+        ++m_framesSinceScan >= TRACK_RESCAN_INTERVAL ||
+        fabs(frame.energy - m_scanEnergy) > TRACK_ENERGY_CHANGE * m_scanEnergy) {
+        return false;
     }
-    returnFeatures[0].push_back(feature);
 
-    free_filter(lpf);
-    return returnFeatures;
+    float thresh = 1e-9f;
+    size_t w = m_trackWindow;
+    vector<float> window(2 * w + 3);
+    for (size_t p = 0; p < m_partialBins.size(); ++p) {
+        size_t b = m_partialBins[p];
+        size_t lo = std::max(m_frontEnd.getLoBin(), (b > w + 2 ? b - w : 2));
+        size_t hi = std::min(m_frontEnd.getHiBin(), b + w);
+        bool found = false;
+        // the smoothed spectrum from lo-2 to hi, formed if decimated
+        m_frontEnd.getSmoothed(frame, lo - 2, hi, &window[0]);
+        for (size_t i = lo; i <= hi; ++i) {
+            // same zero crossing detector as the full scan
+            const float *v = &window[i - lo + 2];
+            if ((v[-1] - v[-2] > thresh) && (v[0] - v[-1] < -thresh)) {
+                peak_idx.push_back(i);
+                found = true;
+            }
+        }
+        if (!found) { // a tracked partial has gone: rescan
+            peak_idx.clear();
+            return false;
+        }
+    }
+
+    // windows around neighbouring partials may overlap
+    std::sort(peak_idx.begin(), peak_idx.end());
+    peak_idx.erase(std::unique(peak_idx.begin(), peak_idx.end()), peak_idx.end());
+    return true;
+}
+
+/*
+ * Assign this frame's partials to track slots: each live track continues
+ * with the nearest unclaimed partial within the tracking window, or ends;
+ * remaining partials start new tracks in free slots.
+ */
+void
+Dissonance::updateTracks()
+{
+    vector<bool> taken(m_partialBins.size(), false);
+    for (size_t s = 0; s < m_trackBins.size(); ++s) {
+        if (!m_trackBins[s]) continue;
+        int best = -1;
+        size_t bestDist = m_trackWindow + 1;
+        for (size_t p = 0; p < m_partialBins.size(); ++p) {
+            if (taken[p]) continue;
+            size_t b = m_partialBins[p];
+            size_t dist = (b > m_trackBins[s] ? b - m_trackBins[s] : m_trackBins[s] - b);
+            if (dist < bestDist) {
+                best = p;
+                bestDist = dist;
+            }
+        }
+        if (best >= 0) {
+            m_trackBins[s] = m_partialBins[best];
+            taken[best] = true;
+        } else {
+            m_trackBins[s] = 0;
+        }
+    }
+    size_t s = 0;
+    for (size_t p = 0; p < m_partialBins.size(); ++p) {
+        if (taken[p]) continue;
+        while (s < m_trackBins.size() && m_trackBins[s]) ++s;
+        if (s == m_trackBins.size()) break;
+        m_trackBins[s] = m_partialBins[p];
+    }
 }
 
 Dissonance::FeatureSet
 Dissonance::getRemainingFeatures()
 {
-    return FeatureSet();
+    FeatureSet returnFeatures;
+    if (m_pipeline) {
+        while (collectFrame(returnFeatures, true)) ;
+    }
+    if (m_summary && m_segmentOpen && m_stats.getCount()) {
+        returnFeatures[2].push_back(summaryFeature());
+        m_stats.reset();
+        m_segmentOpen = false;
+    }
+    return returnFeatures;
 }
 
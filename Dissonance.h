@@ -15,10 +15,13 @@
 
 #include "vamp-sdk/Plugin.h"
 
-extern "C" {
-#include "iirfilter.h"
-}
+#include "SpectralFrontEnd.h"
+#include "DissonanceModel.h"
+#include "SummaryStats.h"
 
+#include <vector>
+
+class FramePipeline;
 
 /**
  * Plugin that calculates the dissonance function of the
@@ -28,12 +31,10 @@ extern "C" {
 class Dissonance : public Vamp::Plugin
 {
 public:
-  FILTER * lpf;
     Dissonance(float inputSampleRate);
     virtual ~Dissonance();
 
     bool initialise(size_t channels, size_t stepSize, size_t blockSize);
-    void initialise_filter();
     void reset();
 
     InputDomain getInputDomain() const { return FrequencyDomain; }
@@ -48,6 +49,10 @@ public:
 
     std::string getCopyright() const;
 
+    ParameterList getParameterDescriptors() const;
+    float getParameter(std::string id) const;
+    void setParameter(std::string id, float value);
+
     OutputList getOutputDescriptors() const;
 
     FeatureSet process(const float *const *inputBuffers,
@@ -55,9 +60,108 @@ public:
 
     FeatureSet getRemainingFeatures();
 
+    /**
+     * Equivalent to count calls to process(), one per spectrum, but
+     * smoothing the spectra side by side in the lanes of a FILTERBANK.
+     * Used by the batch tools, which have many frames to hand at once.
+     * If partials is non-null it receives each frame's partials.
+     */
+    void processFrames(const float *const *spectra, size_t count,
+                       std::vector<FeatureSet> &features,
+                       std::vector<std::vector<FreqSortPair> > *partials = 0);
+
+    /* Default number of partials entering the dissonance sum */
+    static const size_t MaxPartials = 20;
+
+    /**
+     * Front end of process(): magnitudes, smoothing and peak picking.
+     * Fills partials with up to numpartials of the strongest spectral
+     * peaks, sorted by ascending frequency.  The dissonance model
+     * constants play no part in this stage.
+     */
+    void findPartials(const float *spectrum, std::vector<FreqSortPair> &partials);
+
+    /**
+     * Final stage of process(): the dissonance of a list of partials
+     * sorted by ascending frequency, pruned if model.pruning is set.
+     */
+    static float dissonance(const std::vector<FreqSortPair> &partials,
+                            const DissonanceModel &model) {
+        return model.evaluate(partials.empty() ? 0 : &partials[0], partials.size());
+    }
+
+    /** See DissonanceModel::errorBound(). */
+    static float pruningErrorBound(const std::vector<FreqSortPair> &partials,
+                                   const DissonanceModel &model) {
+        return model.errorBound(partials.empty() ? 0 : &partials[0], partials.size());
+    }
+
+    /** Quality of service level of the most recent frame (see "budget"). */
+    int getQosLevel() const { return m_qosLevel; }
+
+    /** Partials selected by the most recent call to process(). */
+    const std::vector<FreqSortPair> &getPartials() const { return m_partials; }
+
+    /**
+     * Frames since the last reset() whose smoothing filter produced
+     * subnormal values (flushed to zero).  Frames smoothed together by
+     * processFrames() are counted together.
+     */
+    size_t getDenormalFrameCount() const;
+
+    const DissonanceModel &getModel() const { return m_model; }
+    void setModel(const DissonanceModel &model) { m_model = model; }
+
 protected:
+    FeatureSet outputFeatures(Vamp::RealTime timestamp);
+    bool collectFrame(FeatureSet &features, bool wait);
+    Feature summaryFeature() const;
+    void pickPartials(const SpectralFrame &frame, std::vector<FreqSortPair> &partials);
+    bool trackPeaks(const SpectralFrame &frame, std::vector<size_t> &peak_idx);
+    void updateTracks();
+    void updateQos(double seconds);
+    void setQosLevel(int level);
+
     size_t m_stepSize;
     size_t m_blockSize;
+    DissonanceModel m_model;
+    SpectralFrontEnd m_frontEnd;
+    std::vector<SpectralFrame> m_frames;
+    std::vector<FreqSortPair> m_partials;
+    std::vector<size_t> m_partialBins; // bins of m_partials, strongest first
+    size_t m_numPartials;
+    size_t m_decimation;              // smoothing decimation, 1 for none
+    size_t m_activePartials;          // m_numPartials, or fewer under QoS
+
+    // Pipelined processing
+    size_t m_threads;                 // worker threads, 0 to analyse in process()
+    FramePipeline *m_pipeline;
+
+    // Partial tracking
+    bool m_tracking;
+    int m_trackWindow;                // search half-width in bins
+    size_t m_framesSinceScan;
+    float m_scanEnergy;               // spectral energy at the last full scan
+    std::vector<size_t> m_trackBins;  // bin of each track slot, 0 if empty
+
+    // Analysis range
+    float m_minFreq;
+    float m_maxFreq;
+
+    // Summary statistics output
+    bool m_summary;
+    float m_summaryPeriod;            // seconds per segment, 0 for whole input
+    SummaryStats m_stats;
+    bool m_segmentOpen;
+    Vamp::RealTime m_segmentStart;
+    Vamp::RealTime m_segmentEnd;
+    size_t m_frameCount;              // frames processed since reset()
+
+    // Quality of service
+    float m_budget;                   // ms per block, 0 for no QoS
+    int m_qosLevel;                   // cheaper analyses in use
+    float m_qosLoad;                  // recent process() time / budget
+    size_t m_qosHold;                 // frames since the level changed
 };
 
 
@@ -0,0 +1,174 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * DissonanceModel -
+ * The Sethares dissonance of a set of spectral partials, with no
+ * dependence on the Vamp SDK.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "DissonanceModel.h"
+
+#include <math.h>
+#include <algorithm>
+
+static bool MagComparator ( const FreqSortPair& l, const FreqSortPair& r)
+{ return l.second > r.second; }
+
+static bool FreqComparator ( const FreqSortPair& l, const FreqSortPair& r)
+{ return l.first < r.first; }
+
+float
+DissonanceModel::evaluate(const FreqSortPair *freqs_mags, size_t N) const
+{
+    if (pruning > 0.0f) return evaluatePruned(freqs_mags, N);
+
+    // Finally, compute the dissonance function
+    float diss_val = 0.0f;
+    for(size_t i = 1; i<N; ++i){
+        for(size_t j = 0; j < N-i ; ++j){
+            float S = Dstar / (s1 * freqs_mags[j].first + s2 );
+            float Fdif = freqs_mags[j+i].first - freqs_mags[j].first;
+            float am = freqs_mags[j+i].second * freqs_mags[j].second;
+            diss_val += am * ( c1 * exp(b1 * S * Fdif) + c2 * exp(b2 * S * Fdif) );
+        }
+    }
+    return diss_val;
+}
+
+/*
+ * The pruned sum goes partial by partial: the partials are sorted by
+ * frequency, so each one's inner loop can stop at the first partial
+ * beyond the pruning distance.  For partials of a given density the
+ * work is then linear in N rather than quadratic.  Large N is the point
+ * of pruning, so the sum is accumulated in double precision.
+ */
+float
+DissonanceModel::evaluatePruned(const FreqSortPair *freqs_mags, size_t N) const
+{
+    double diss_val = 0.0;
+    for(size_t j = 0; j + 1 < N; ++j){
+        float band = s1 * freqs_mags[j].first + s2; // critical bandwidth
+        float S = Dstar / band;
+        float limit = freqs_mags[j].first + pruning * band;
+        for(size_t k = j + 1; k < N && freqs_mags[k].first <= limit; ++k){
+            float Fdif = freqs_mags[k].first - freqs_mags[j].first;
+            float am = freqs_mags[k].second * freqs_mags[j].second;
+            diss_val += am * ( c1 * exp(b1 * S * Fdif) + c2 * exp(b2 * S * Fdif) );
+        }
+    }
+    return diss_val;
+}
+
+float
+DissonanceModel::errorBound(const FreqSortPair *freqs_mags, size_t N) const
+{
+    if (pruning <= 0.0f) return 0.0f;
+    float x = Dstar * pruning;
+    double curve = fabs(c1) * exp(b1 * x) + fabs(c2) * exp(b2 * x);
+    // sum over pairs of a_j a_k = ((sum a)^2 - sum a^2) / 2
+    double sum = 0.0, sumsq = 0.0;
+    for (size_t i = 0; i < N; ++i) {
+        sum += freqs_mags[i].second;
+        sumsq += freqs_mags[i].second * freqs_mags[i].second;
+    }
+    return curve * 0.5 * (sum * sum - sumsq);
+}
+
+void
+DissonanceSweep::add(const DissonanceModel &model, size_t numPartials)
+{
+    size_t index = m_count++;
+    m_maxPartials = std::max(m_maxPartials, numPartials);
+
+    if (model.pruning > 0.0f) {
+        Pruned p;
+        p.index = index;
+        p.numPartials = numPartials;
+        p.model = model;
+        m_pruned.push_back(p);
+        return;
+    }
+
+    size_t g = 0;
+    while (g < m_groups.size() && m_groups[g].numPartials != numPartials) ++g;
+    if (g == m_groups.size()) {
+        m_groups.push_back(Group());
+        m_groups[g].numPartials = numPartials;
+    }
+    Group &group = m_groups[g];
+    group.index.push_back(index);
+    group.b1.push_back(model.b1);
+    group.b2.push_back(model.b2);
+    group.s1.push_back(model.s1);
+    group.s2.push_back(model.s2);
+    group.c1.push_back(model.c1);
+    group.c2.push_back(model.c2);
+    group.Dstar.push_back(model.Dstar);
+    group.sums.push_back(0.0f);
+}
+
+/*
+ * The numPartials strongest of count partials, sorted by frequency: the
+ * selection SpectralFrontEnd::selectPartials() would have made with
+ * that limit, but for ties in magnitude.  Points into partials if all
+ * of them are wanted, otherwise into m_subset.
+ */
+const FreqSortPair *
+DissonanceSweep::strongest(const FreqSortPair *partials, size_t count,
+                           size_t numPartials)
+{
+    if (count <= numPartials) return partials;
+    m_subset.assign(m_byMag.begin(), m_byMag.begin() + numPartials);
+    std::sort(m_subset.begin(), m_subset.end(), FreqComparator);
+    return &m_subset[0];
+}
+
+/*
+ * The pairs are visited in the order of DissonanceModel::evaluate(),
+ * and each configuration's sum is formed with the same expressions, so
+ * the values match it exactly.
+ */
+void
+DissonanceSweep::evaluate(const FreqSortPair *partials, size_t count, float *values)
+{
+    if (count > 0) {
+        m_byMag.assign(partials, partials + count);
+        std::sort(m_byMag.begin(), m_byMag.end(), MagComparator);
+    }
+
+    for (size_t g = 0; g < m_groups.size(); ++g) {
+        Group &group = m_groups[g];
+        size_t N = std::min(count, group.numPartials);
+        const FreqSortPair *freqs_mags = strongest(partials, count, group.numPartials);
+        size_t M = group.index.size();
+        const float *b1 = &group.b1[0], *b2 = &group.b2[0];
+        const float *s1 = &group.s1[0], *s2 = &group.s2[0];
+        const float *c1 = &group.c1[0], *c2 = &group.c2[0];
+        const float *Dstar = &group.Dstar[0];
+        float *sums = &group.sums[0];
+        std::fill(sums, sums + M, 0.0f);
+        for(size_t i = 1; i<N; ++i){
+            for(size_t j = 0; j < N-i ; ++j){
+                float f = freqs_mags[j].first;
+                float Fdif = freqs_mags[j+i].first - f;
+                float am = freqs_mags[j+i].second * freqs_mags[j].second;
+                for (size_t m = 0; m < M; ++m) {
+                    float S = Dstar[m] / (s1[m] * f + s2[m] );
+                    sums[m] += am * ( c1[m] * exp(b1[m] * S * Fdif) + c2[m] * exp(b2[m] * S * Fdif) );
+                }
+            }
+        }
+        for (size_t m = 0; m < M; ++m) values[group.index[m]] = sums[m];
+    }
+
+    for (size_t p = 0; p < m_pruned.size(); ++p) {
+        const Pruned &pruned = m_pruned[p];
+        size_t N = std::min(count, pruned.numPartials);
+        values[pruned.index] =
+            pruned.model.evaluate(strongest(partials, count, pruned.numPartials), N);
+    }
+}
@@ -0,0 +1,113 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * DissonanceModel -
+ * The Sethares dissonance of a set of spectral partials, with no
+ * dependence on the Vamp SDK.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_DISSONANCE_MODEL_H_
+#define _BREGMAN_DISSONANCE_MODEL_H_
+
+#include "SpectralFrontEnd.h"
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Constants of the Sethares dissonance model evaluated over each pair
+ * of partials.  The defaults are those of Sethares (1993).
+ *
+ * If pruning is positive, pairs further apart than pruning critical
+ * bandwidths (s1 * f + s2 Hz at the lower partial f) are skipped; see
+ * errorBound().  0 evaluates every pair.
+ */
+struct DissonanceModel
+{
+    DissonanceModel() :
+        b1(-3.51f), b2(-5.75f), s1(0.0207f), s2(19.96f),
+        c1(5.0f), c2(-5.0f), Dstar(0.24f), pruning(0.0f) { }
+
+    float b1, b2, s1, s2, c1, c2, Dstar;
+    float pruning;
+
+    /**
+     * The dissonance of count partials sorted by ascending frequency,
+     * pruned if pruning is set.
+     */
+    float evaluate(const FreqSortPair *partials, size_t count) const;
+
+    /**
+     * Largest possible difference between the pruned and the exact
+     * dissonance of count partials: every skipped pair lies past the
+     * pruning distance, where the model curve is bounded by
+     * |c1| exp(b1 Dstar pruning) + |c2| exp(b2 Dstar pruning), so the
+     * error is at most that bound times the sum of the magnitude
+     * products of all pairs.
+     */
+    float errorBound(const FreqSortPair *partials, size_t count) const;
+
+protected:
+    float evaluatePruned(const FreqSortPair *partials, size_t count) const;
+};
+
+/**
+ * A set of configurations -- a model and the number of strongest
+ * partials it is evaluated over -- that are evaluated against the same
+ * partials at once, for calibrating the model constants.
+ *
+ * Configurations with the same partial count share one pass over the
+ * pairs of partials, with the constants laid out by configuration so
+ * that the innermost loop runs across configurations.  Each value is
+ * identical to DissonanceModel::evaluate() of its configuration.
+ */
+class DissonanceSweep
+{
+public:
+    DissonanceSweep() : m_count(0), m_maxPartials(0) { }
+
+    /** Add a configuration; its values go to the next index. */
+    void add(const DissonanceModel &model, size_t numPartials);
+
+    size_t getCount() const { return m_count; }
+    size_t getMaxPartials() const { return m_maxPartials; }
+
+    /**
+     * The dissonance of each configuration, into values[0..getCount()-1].
+     * partials are sorted by ascending frequency and are the (up to)
+     * getMaxPartials() strongest of the frame.
+     */
+    void evaluate(const FreqSortPair *partials, size_t count, float *values);
+
+protected:
+    // unpruned configurations with one partial count
+    struct Group
+    {
+        size_t numPartials;
+        std::vector<size_t> index;
+        std::vector<float> b1, b2, s1, s2, c1, c2, Dstar;
+        std::vector<float> sums;
+    };
+    struct Pruned
+    {
+        size_t index;
+        size_t numPartials;
+        DissonanceModel model;
+    };
+
+    const FreqSortPair *strongest(const FreqSortPair *partials, size_t count,
+                                  size_t numPartials);
+
+    size_t m_count;
+    size_t m_maxPartials;
+    std::vector<Group> m_groups;
+    std::vector<Pruned> m_pruned;
+    std::vector<FreqSortPair> m_byMag;   // partials, strongest first
+    std::vector<FreqSortPair> m_subset;  // the strongest few, by frequency
+};
+
+#endif
@@ -0,0 +1,258 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * FeatureFile -
+ * A compact columnar binary container for dense (one value per step)
+ * feature outputs, designed to be mmap()ed and sliced without parsing.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "FeatureFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+
+static size_t
+alignUp(size_t n)
+{
+    return (n + FEATURE_FILE_ALIGN - 1) / FEATURE_FILE_ALIGN * FEATURE_FILE_ALIGN;
+}
+
+FeatureFileWriter::FeatureFileWriter(float sampleRate, size_t stepSize,
+                                     size_t blockSize, string pluginId,
+                                     int pluginVersion) :
+    m_sampleRate(sampleRate),
+    m_stepSize(stepSize),
+    m_blockSize(blockSize),
+    m_pluginId(pluginId),
+    m_pluginVersion(pluginVersion),
+    m_frameCount(0)
+{
+}
+
+int
+FeatureFileWriter::addOutput(string identifier, size_t binCount)
+{
+    Output o;
+    o.identifier = identifier;
+    o.binCount = binCount;
+    o.columns.resize(binCount, vector<float>
+                     (m_frameCount, std::numeric_limits<float>::quiet_NaN()));
+    m_outputs.push_back(o);
+    return int(m_outputs.size()) - 1;
+}
+
+void
+FeatureFileWriter::setFrameCount(size_t frameCount)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    m_frameCount = frameCount;
+    for (size_t o = 0; o < m_outputs.size(); ++o) {
+        for (size_t b = 0; b < m_outputs[o].binCount; ++b) {
+            m_outputs[o].columns[b].resize(frameCount, nan);
+        }
+    }
+}
+
+void
+FeatureFileWriter::setValues(int output, size_t frame, const vector<float> &values)
+{
+    if (output < 0 || output >= int(m_outputs.size())) return;
+    if (frame >= m_frameCount) setFrameCount(frame + 1);
+    Output &o = m_outputs[output];
+    for (size_t b = 0; b < o.binCount && b < values.size(); ++b) {
+        o.columns[b][frame] = values[b];
+    }
+}
+
+bool
+FeatureFileWriter::write(string path) const
+{
+    FeatureFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FEATURE_FILE_MAGIC, sizeof(FEATURE_FILE_MAGIC));
+    h.formatVersion = FEATURE_FILE_VERSION;
+    h.outputCount = m_outputs.size();
+    h.frameCount = m_frameCount;
+    h.sampleRate = m_sampleRate;
+    h.stepSize = m_stepSize;
+    h.blockSize = m_blockSize;
+    h.pluginVersion = m_pluginVersion;
+    strncpy(h.pluginId, m_pluginId.c_str(), sizeof(h.pluginId) - 1);
+
+    vector<FeatureFileOutput> table(m_outputs.size());
+    size_t offset = alignUp(sizeof(h) + table.size() * sizeof(FeatureFileOutput));
+    for (size_t o = 0; o < m_outputs.size(); ++o) {
+        memset(&table[o], 0, sizeof(FeatureFileOutput));
+        strncpy(table[o].identifier, m_outputs[o].identifier.c_str(),
+                FEATURE_FILE_ID_LEN - 1);
+        table[o].binCount = m_outputs[o].binCount;
+        table[o].dataOffset = offset;
+        table[o].dataSize = uint64_t(m_outputs[o].binCount) * m_frameCount * sizeof(float);
+        offset = alignUp(offset + table[o].dataSize);
+    }
+
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        perror(path.c_str());
+        return false;
+    }
+
+    bool ok = (fwrite(&h, sizeof(h), 1, fp) == 1);
+    if (ok && !table.empty()) {
+        ok = (fwrite(&table[0], sizeof(FeatureFileOutput), table.size(), fp) == table.size());
+    }
+
+    const char zeros[FEATURE_FILE_ALIGN] = { 0 };
+    size_t written = sizeof(h) + table.size() * sizeof(FeatureFileOutput);
+    for (size_t o = 0; ok && o < m_outputs.size(); ++o) {
+        ok = (fwrite(zeros, 1, table[o].dataOffset - written, fp) == table[o].dataOffset - written);
+        written = table[o].dataOffset;
+        for (size_t b = 0; ok && b < m_outputs[o].binCount; ++b) {
+            const vector<float> &col = m_outputs[o].columns[b];
+            if (m_frameCount == 0) continue;
+            ok = (fwrite(&col[0], sizeof(float), m_frameCount, fp) == m_frameCount);
+            written += m_frameCount * sizeof(float);
+        }
+    }
+    if (ok) {
+        size_t end = alignUp(written);
+        ok = (fwrite(zeros, 1, end - written, fp) == end - written);
+    }
+
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "ERROR: FeatureFileWriter: failed to write \"%s\"\n", path.c_str());
+    }
+    return ok;
+}
+
+FeatureFileReader::FeatureFileReader() :
+    m_base(0),
+    m_size(0),
+    m_header(0),
+    m_outputs(0)
+{
+}
+
+FeatureFileReader::~FeatureFileReader()
+{
+    close();
+}
+
+bool
+FeatureFileReader::open(string path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_error = "cannot open \"" + path + "\": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FeatureFileHeader)) {
+        m_error = "\"" + path + "\" is too short to be a feature file";
+        ::close(fd);
+        return false;
+    }
+    void *base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        m_error = "cannot map \"" + path + "\": " + strerror(errno);
+        return false;
+    }
+    m_base = base;
+    m_size = st.st_size;
+    m_header = (const FeatureFileHeader *)m_base;
+    m_outputs = (const FeatureFileOutput *)(m_header + 1);
+
+    if (strncmp(m_header->magic, FEATURE_FILE_MAGIC, sizeof(m_header->magic))) {
+        m_error = "\"" + path + "\" is not a feature file";
+        close();
+        return false;
+    }
+    if (m_header->formatVersion == __builtin_bswap32(FEATURE_FILE_VERSION)) {
+        m_error = "\"" + path + "\" was written on a machine of the other byte order";
+        close();
+        return false;
+    }
+    if (m_header->formatVersion != FEATURE_FILE_VERSION) {
+        m_error = "\"" + path + "\" has an unsupported format version";
+        close();
+        return false;
+    }
+    if (sizeof(FeatureFileHeader) +
+        uint64_t(m_header->outputCount) * sizeof(FeatureFileOutput) > m_size) {
+        m_error = "\"" + path + "\" has a truncated output table";
+        close();
+        return false;
+    }
+    for (size_t o = 0; o < m_header->outputCount; ++o) {
+        // arranged so that no field, however large, can overflow
+        const FeatureFileOutput &out = m_outputs[o];
+        const uint64_t binBytes = uint64_t(out.binCount) * sizeof(float);
+        if (out.dataOffset % FEATURE_FILE_ALIGN ||
+            out.dataOffset > m_size || out.dataSize > m_size - out.dataOffset ||
+            (binBytes ? (out.dataSize % binBytes ||
+                         out.dataSize / binBytes != m_header->frameCount)
+                      : out.dataSize != 0)) {
+            m_error = "\"" + path + "\" has a truncated or corrupt data section";
+            close();
+            return false;
+        }
+    }
+
+    m_error = "";
+    return true;
+}
+
+void
+FeatureFileReader::close()
+{
+    if (m_base) {
+        munmap(m_base, m_size);
+    }
+    m_base = 0;
+    m_size = 0;
+    m_header = 0;
+    m_outputs = 0;
+}
+
+int
+FeatureFileReader::findOutput(string identifier) const
+{
+    for (size_t o = 0; o < getOutputCount(); ++o) {
+        const char *id = m_outputs[o].identifier;
+        if (identifier == string(id, strnlen(id, FEATURE_FILE_ID_LEN))) return int(o);
+    }
+    return -1;
+}
+
+const float *
+FeatureFileReader::getColumn(size_t output, size_t bin) const
+{
+    if (output >= getOutputCount() || bin >= m_outputs[output].binCount) return 0;
+    return (const float *)((const char *)m_base + m_outputs[output].dataOffset) +
+        bin * getFrameCount();
+}
+
+double
+FeatureFileReader::getFrameTime(size_t frame) const
+{
+    return double(frame) * m_header->stepSize / m_header->sampleRate;
+}
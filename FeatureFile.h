@@ -0,0 +1,144 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * FeatureFile -
+ * A compact columnar binary container for dense (one value per step)
+ * feature outputs, designed to be mmap()ed and sliced without parsing.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_FEATURE_FILE_H_
+#define _BREGMAN_FEATURE_FILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+ * File layout (all fields in the byte order of the machine that wrote
+ * the file, which formatVersion identifies; every section 64-byte
+ * aligned):
+ *
+ *   FeatureFileHeader                      64 bytes
+ *   FeatureFileOutput[outputCount]         64 bytes each
+ *   padding to the first data offset
+ *   output 0: bin 0 column, bin 1 column, ... (frameCount float32 each)
+ *   output 1: ...
+ *
+ * Frame k of every column is the value computed for the block starting
+ * at sample k * stepSize, i.e. at time k * stepSize / sampleRate.
+ * Frames for which the plugin returned no value hold NaN.
+ */
+
+#define FEATURE_FILE_MAGIC "BRGFEAT"
+#define FEATURE_FILE_VERSION 1
+#define FEATURE_FILE_ALIGN 64
+#define FEATURE_FILE_ID_LEN 40
+
+struct FeatureFileHeader
+{
+    char magic[8];              /* FEATURE_FILE_MAGIC, NUL-terminated */
+    uint32_t formatVersion;     /* FEATURE_FILE_VERSION */
+    uint32_t outputCount;       /* number of FeatureFileOutput records */
+    uint64_t frameCount;        /* rows in every column */
+    float sampleRate;           /* input sample rate of the analysis */
+    uint32_t stepSize;          /* hop in samples between frames */
+    uint32_t blockSize;         /* analysis block length in samples */
+    int32_t pluginVersion;      /* getPluginVersion() of the producer */
+    char pluginId[24];          /* getIdentifier() of the producer */
+};
+
+struct FeatureFileOutput
+{
+    char identifier[FEATURE_FILE_ID_LEN]; /* output identifier */
+    uint32_t binCount;          /* number of columns in this output */
+    uint32_t reserved;
+    uint64_t dataOffset;        /* byte offset of bin 0 from file start */
+    uint64_t dataSize;          /* binCount * frameCount * sizeof(float) */
+};
+
+/**
+ * Accumulates per-frame output values and writes them out as a
+ * FeatureFile by write().  Columns are buffered in memory, since the
+ * frame count is only known once the input is exhausted.
+ */
+
+class FeatureFileWriter
+{
+public:
+    FeatureFileWriter(float sampleRate, size_t stepSize, size_t blockSize,
+                      std::string pluginId, int pluginVersion);
+
+    /** Declare an output; returns its index for use with setValues(). */
+    int addOutput(std::string identifier, size_t binCount);
+
+    /** Store the values of output for frame (missing bins are NaN). */
+    void setValues(int output, size_t frame, const std::vector<float> &values);
+
+    size_t getFrameCount() const { return m_frameCount; }
+    void setFrameCount(size_t frameCount);
+
+    bool write(std::string path) const;
+
+protected:
+    struct Output {
+        std::string identifier;
+        size_t binCount;
+        std::vector<std::vector<float> > columns;
+    };
+
+    float m_sampleRate;
+    size_t m_stepSize;
+    size_t m_blockSize;
+    std::string m_pluginId;
+    int m_pluginVersion;
+    size_t m_frameCount;
+    std::vector<Output> m_outputs;
+};
+
+/**
+ * Read-only view of a FeatureFile.  The file is mapped into memory and
+ * columns are returned as pointers into the mapping, so slicing a frame
+ * range touches only the pages it covers.
+ */
+
+class FeatureFileReader
+{
+public:
+    FeatureFileReader();
+    virtual ~FeatureFileReader();
+
+    bool open(std::string path);
+    void close();
+    bool isOpen() const { return m_base != 0; }
+    std::string getError() const { return m_error; }
+
+    const FeatureFileHeader &getHeader() const { return *m_header; }
+    size_t getFrameCount() const { return m_header->frameCount; }
+    size_t getOutputCount() const { return m_header->outputCount; }
+    const FeatureFileOutput &getOutput(size_t output) const {
+        return m_outputs[output];
+    }
+
+    /** Index of the output with the given identifier, or -1. */
+    int findOutput(std::string identifier) const;
+
+    /** Pointer to getFrameCount() floats for the given output bin. */
+    const float *getColumn(size_t output, size_t bin) const;
+
+    /** Time in seconds of the start of frame. */
+    double getFrameTime(size_t frame) const;
+
+protected:
+    void *m_base;
+    size_t m_size;
+    const FeatureFileHeader *m_header;
+    const FeatureFileOutput *m_outputs;
+    std::string m_error;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * FramePipeline -
+ * Runs the spectral front end on worker threads, so that a plugin's
+ * process() can queue a frame and return while it is analysed.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "FramePipeline.h"
+
+#include <algorithm>
+#include <iostream>
+
+using std::cerr;
+using std::endl;
+
+FramePipeline::Worker::Worker(const SpectralFrontEnd &frontEnd_, size_t depth) :
+    pipeline(0),
+    frontEnd(frontEnd_),
+    in(depth),
+    out(depth),
+    stop(0)
+{
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&cond, 0);
+}
+
+FramePipeline::Worker::~Worker()
+{
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+FramePipeline::FramePipeline(const SpectralFrontEnd &frontEnd, size_t threads,
+                             size_t depth) :
+    m_submitted(0),
+    m_collected(0)
+{
+    if (threads < 1) threads = 1;
+    if (depth < 1) depth = 1;
+
+    pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_cond, 0);
+
+    m_slots.resize(threads * depth);
+    for (size_t i = 0; i < m_slots.size(); ++i) {
+        m_slots[i].spectrum.resize(frontEnd.getBlockSize() + 2);
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        Worker *w = new Worker(frontEnd, depth);
+        w->pipeline = this;
+        w->frontEnd.resetDenormalFrameCount();
+        if (pthread_create(&w->thread, 0, run, w) != 0) {
+            cerr << "ERROR: FramePipeline: cannot start worker thread" << endl;
+            delete w;
+            break;
+        }
+        m_workers.push_back(w);
+    }
+    // with fewer workers than asked for, slots dealt to the missing
+    // ones are never completed
+    m_slots.resize(m_workers.size() * depth);
+}
+
+FramePipeline::~FramePipeline()
+{
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        Worker *w = m_workers[i];
+        pthread_mutex_lock(&w->mutex);
+        __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->mutex);
+        pthread_join(w->thread, 0);
+        delete w;
+    }
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+void *
+FramePipeline::run(void *arg)
+{
+    Worker &w = *(Worker *)arg;
+    FramePipeline &p = *w.pipeline;
+    while (true) {
+        if (!w.in.getReadSpace()) {
+            pthread_mutex_lock(&w.mutex);
+            while (!w.in.getReadSpace() && !__atomic_load_n(&w.stop, __ATOMIC_ACQUIRE)) {
+                pthread_cond_wait(&w.cond, &w.mutex);
+            }
+            pthread_mutex_unlock(&w.mutex);
+            if (!w.in.getReadSpace()) break; // stopped
+        }
+        size_t index = w.in.front();
+        w.in.pop();
+        Slot &slot = p.m_slots[index];
+        w.frontEnd.analyse(&slot.spectrum[0], slot.frame);
+        w.out.write(&index, 1);
+
+        pthread_mutex_lock(&p.m_mutex);
+        pthread_cond_signal(&p.m_cond);
+        pthread_mutex_unlock(&p.m_mutex);
+    }
+    return 0;
+}
+
+void
+FramePipeline::submit(const float *spectrum, Vamp::RealTime timestamp)
+{
+    if (m_workers.empty() || isFull()) {
+        cerr << "ERROR: FramePipeline::submit: no free slot" << endl;
+        return;
+    }
+    size_t index = m_submitted % m_slots.size();
+    Slot &slot = m_slots[index];
+    std::copy(spectrum, spectrum + slot.spectrum.size(), slot.spectrum.begin());
+    slot.timestamp = timestamp;
+
+    Worker &w = *m_workers[m_submitted % m_workers.size()];
+    w.in.write(&index, 1);
+    ++m_submitted;
+
+    pthread_mutex_lock(&w.mutex);
+    pthread_cond_signal(&w.cond);
+    pthread_mutex_unlock(&w.mutex);
+}
+
+const SpectralFrame *
+FramePipeline::next(Vamp::RealTime &timestamp, bool wait)
+{
+    if (m_collected == m_submitted) return 0;
+    Worker &w = *m_workers[m_collected % m_workers.size()];
+    if (!w.out.getReadSpace()) {
+        if (!wait) return 0;
+        pthread_mutex_lock(&m_mutex);
+        while (!w.out.getReadSpace()) {
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        pthread_mutex_unlock(&m_mutex);
+    }
+    const Slot &slot = m_slots[w.out.front()];
+    timestamp = slot.timestamp;
+    return &slot.frame;
+}
+
+void
+FramePipeline::release()
+{
+    if (m_collected == m_submitted) return;
+    m_workers[m_collected % m_workers.size()]->out.pop();
+    ++m_collected;
+}
+
+size_t
+FramePipeline::getDenormalFrameCount() const
+{
+    // exact once every frame has been collected: each worker counts a
+    // frame before handing it back
+    size_t count = 0;
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        count += m_workers[i]->frontEnd.getDenormalFrameCount();
+    }
+    return count;
+}
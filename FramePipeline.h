@@ -0,0 +1,110 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * FramePipeline -
+ * Runs the spectral front end on worker threads, so that a plugin's
+ * process() can queue a frame and return while it is analysed.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_FRAME_PIPELINE_H_
+#define _BREGMAN_FRAME_PIPELINE_H_
+
+#include "SpectralFrontEnd.h"
+#include "SPSCRing.h"
+
+#include "vamp-sdk/RealTime.h"
+
+#include <pthread.h>
+#include <vector>
+
+/**
+ * A fixed pool of frame slots shared by one submitting thread and a set
+ * of workers, each with its own copy of the front end.  Frames are dealt
+ * to the workers in turn and each worker completes its frames in order,
+ * so taking them back from the workers in the same turn returns them in
+ * submission order.
+ *
+ * Slot indices travel to and from each worker through a pair of
+ * SPSCRings; the slot contents are handed over by the ordering of the
+ * ring positions.  Mutexes are used only for sleeping on an empty ring.
+ *
+ * All calls except the constructor and destructor are made from the
+ * submitting thread.
+ */
+
+class FramePipeline
+{
+public:
+    /**
+     * threads workers, each holding up to depth frames, with copies of
+     * frontEnd, which must have been initialised.
+     */
+    FramePipeline(const SpectralFrontEnd &frontEnd, size_t threads, size_t depth);
+    ~FramePipeline();
+
+    /** False if no worker thread could be started. */
+    bool isRunning() const { return !m_workers.empty(); }
+
+    /** True if every slot holds a frame not yet released. */
+    bool isFull() const { return m_submitted - m_collected == m_slots.size(); }
+
+    /** Frames submitted and not yet released. */
+    size_t getPending() const { return m_submitted - m_collected; }
+
+    /**
+     * Queue an interleaved re/im spectrum of blockSize/2 + 1 bins for
+     * analysis.  Must not be called when isFull().
+     */
+    void submit(const float *spectrum, Vamp::RealTime timestamp);
+
+    /**
+     * The oldest pending frame and its timestamp, if its analysis is
+     * complete, or 0.  If wait is true and a frame is pending, blocks
+     * until it is complete.  The frame stays valid until release().
+     */
+    const SpectralFrame *next(Vamp::RealTime &timestamp, bool wait);
+    void release();
+
+    /** Frames in which the workers' smoothing produced subnormal values. */
+    size_t getDenormalFrameCount() const;
+
+protected:
+    struct Slot {
+        std::vector<float> spectrum;
+        SpectralFrame frame;
+        Vamp::RealTime timestamp;
+    };
+
+    struct Worker {
+        Worker(const SpectralFrontEnd &frontEnd, size_t depth);
+        ~Worker();
+
+        FramePipeline *pipeline;
+        SpectralFrontEnd frontEnd;
+        SPSCRing<size_t> in;    // slots to analyse
+        SPSCRing<size_t> out;   // slots analysed
+        int stop;
+        pthread_mutex_t mutex;  // only for sleeping on an empty ring
+        pthread_cond_t cond;
+        pthread_t thread;
+    };
+
+    static void *run(void *arg);
+
+    std::vector<Slot> m_slots;
+    std::vector<Worker *> m_workers;
+    size_t m_submitted;
+    size_t m_collected;
+
+    pthread_mutex_t m_mutex;    // for the submitting thread to sleep on
+    pthread_cond_t m_cond;
+
+    FramePipeline(const FramePipeline &);
+    FramePipeline &operator=(const FramePipeline &);
+};
+
+#endif
@@ -0,0 +1,48 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * FrameTransform -
+ * Converts blocks of time-domain audio into the frequency-domain input
+ * layout that Vamp hosts pass to FrequencyDomain plugins, so the batch
+ * tools can drive the Bregman plugins directly without a plugin loader.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "FrameTransform.h"
+#include "vamp-sdk/FFT.h"
+
+#include <math.h>
+
+FrameTransform::FrameTransform(size_t blockSize) :
+    m_blockSize(blockSize),
+    m_window(blockSize),
+    m_ri(blockSize),
+    m_ii(blockSize, 0.0),
+    m_ro(blockSize),
+    m_io(blockSize),
+    m_spectrum(blockSize + 2)
+{
+    for (size_t i = 0; i < m_blockSize; ++i) {
+        m_window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * double(i) / double(m_blockSize));
+    }
+}
+
+const float *
+FrameTransform::process(const float *block)
+{
+    size_t half = m_blockSize/2;
+    // window and rotate so the centre of the block is at time zero
+    for (size_t i = 0; i < half; ++i) {
+        m_ri[i] = block[i + half] * m_window[i + half];
+        m_ri[i + half] = block[i] * m_window[i];
+    }
+    Vamp::FFT::forward(m_blockSize, &m_ri[0], &m_ii[0], &m_ro[0], &m_io[0]);
+    for (size_t i = 0; i <= half; ++i) {
+        m_spectrum[i*2] = m_ro[i];
+        m_spectrum[i*2 + 1] = m_io[i];
+    }
+    return &m_spectrum[0];
+}
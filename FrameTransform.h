@@ -0,0 +1,46 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * FrameTransform -
+ * Converts blocks of time-domain audio into the frequency-domain input
+ * layout that Vamp hosts pass to FrequencyDomain plugins, so the batch
+ * tools can drive the Bregman plugins directly without a plugin loader.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_FRAME_TRANSFORM_H_
+#define _BREGMAN_FRAME_TRANSFORM_H_
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Hann-windows a block, rotates it by half a block (as the Vamp SDK's
+ * PluginInputDomainAdapter does) and returns the interleaved re/im
+ * spectrum of bins 0..blockSize/2.  blockSize must be a power of two.
+ */
+
+class FrameTransform
+{
+public:
+    FrameTransform(size_t blockSize);
+
+    size_t getBlockSize() const { return m_blockSize; }
+
+    /** Transform blockSize samples; the result has blockSize+2 floats. */
+    const float *process(const float *block);
+
+protected:
+    size_t m_blockSize;
+    std::vector<double> m_window;
+    std::vector<double> m_ri;
+    std::vector<double> m_ii;
+    std::vector<double> m_ro;
+    std::vector<double> m_io;
+    std::vector<float> m_spectrum;
+};
+
+#endif
@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SPSCRing -
+ * Lock-free single-producer, single-consumer ring buffer.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_SPSC_RING_H_
+#define _BREGMAN_SPSC_RING_H_
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * A fixed-capacity FIFO of T shared between exactly one writing thread
+ * and exactly one reading thread, without locks.  The read and write
+ * positions run freely and are masked into a power-of-two buffer; each
+ * is stored only by its owning thread, with release ordering, and
+ * loaded by the other with acquire ordering, so data written before a
+ * position update is visible to the thread that observes it.
+ *
+ * T must be copyable with memcpy.
+ */
+
+template <typename T>
+class SPSCRing
+{
+public:
+    /** capacity is rounded up to a power of two. */
+    SPSCRing(size_t capacity) :
+        m_size(1),
+        m_read(0),
+        m_write(0)
+    {
+        while (m_size < capacity) m_size <<= 1;
+        m_buffer = new T[m_size];
+    }
+
+    ~SPSCRing() {
+        delete[] m_buffer;
+    }
+
+    size_t getCapacity() const { return m_size; }
+
+    /** Items available to read.  Exact for the consumer. */
+    size_t getReadSpace() const {
+        return load(&m_write) - load(&m_read);
+    }
+
+    /** Items that may be written.  Exact for the producer. */
+    size_t getWriteSpace() const {
+        return m_size - (load(&m_write) - load(&m_read));
+    }
+
+    /** Producer: append up to n items; returns the number written. */
+    size_t write(const T *src, size_t n) {
+        size_t w = m_write;
+        size_t space = m_size - (w - load(&m_read));
+        if (n > space) n = space;
+        size_t at = w & (m_size - 1);
+        size_t first = (n < m_size - at ? n : m_size - at);
+        memcpy(m_buffer + at, src, first * sizeof(T));
+        memcpy(m_buffer, src + first, (n - first) * sizeof(T));
+        store(&m_write, w + n);
+        return n;
+    }
+
+    /** Consumer: remove up to n items into dst; returns the number read. */
+    size_t read(T *dst, size_t n) {
+        size_t r = m_read;
+        size_t avail = load(&m_write) - r;
+        if (n > avail) n = avail;
+        size_t at = r & (m_size - 1);
+        size_t first = (n < m_size - at ? n : m_size - at);
+        memcpy(dst, m_buffer + at, first * sizeof(T));
+        memcpy(dst + first, m_buffer, (n - first) * sizeof(T));
+        store(&m_read, r + n);
+        return n;
+    }
+
+    /** Consumer: the oldest item, which must exist. */
+    const T &front() const {
+        return m_buffer[m_read & (m_size - 1)];
+    }
+
+    /** Consumer: discard the oldest item. */
+    void pop() {
+        store(&m_read, m_read + 1);
+    }
+
+private:
+    static size_t load(const size_t *p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+    static void store(size_t *p, size_t v) {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+    T *m_buffer;
+    size_t m_size;
+    // each position on its own cache line, so that the two threads do
+    // not contend for it
+    char m_pad0[64];
+    size_t m_read;
+    char m_pad1[64];
+    size_t m_write;
+    char m_pad2[64];
+
+    SPSCRing(const SPSCRing &);
+    SPSCRing &operator=(const SPSCRing &);
+};
+
+#endif
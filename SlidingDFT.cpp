@@ -0,0 +1,134 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SlidingDFT -
+ * Recursive DFT of a sliding block of audio over a limited range of
+ * bins, updated sample by sample instead of recomputed per block.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "SlidingDFT.h"
+
+#include <algorithm>
+
+const size_t SlidingDFT::ResyncInterval;
+
+SlidingDFT::SlidingDFT() :
+    m_blockSize(0),
+    m_firstBin(0),
+    m_lastBin(0),
+    m_lo(0),
+    m_hi(0),
+    m_pos(0),
+    m_primed(false),
+    m_sinceResync(0)
+{
+}
+
+void
+SlidingDFT::initialise(const SharedSpectralTables &tables,
+                       size_t firstBin, size_t lastBin)
+{
+    size_t blockSize = tables->blockSize;
+    m_tables = tables;
+    m_blockSize = blockSize;
+    m_lastBin = std::min(lastBin, blockSize/2);
+    m_firstBin = std::min(firstBin, m_lastBin);
+    m_lo = (m_firstBin > 0 ? m_firstBin - 1 : 0);
+    m_hi = std::min(blockSize/2, m_lastBin + 1);
+
+    size_t n = m_hi - m_lo + 1;
+    m_re.assign(n, 0.0);
+    m_im.assign(n, 0.0);
+    m_history.assign(blockSize, 0.0f);
+    reset();
+}
+
+void
+SlidingDFT::reset()
+{
+    std::fill(m_re.begin(), m_re.end(), 0.0);
+    std::fill(m_im.begin(), m_im.end(), 0.0);
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    m_pos = 0;
+    m_primed = false;
+    m_sinceResync = 0;
+}
+
+void
+SlidingDFT::update(const float *block, size_t count)
+{
+    if (!m_primed || count >= m_blockSize) {
+        std::copy(block, block + m_blockSize, m_history.begin());
+        m_pos = 0;
+        recompute();
+        m_primed = true;
+        return;
+    }
+
+    const float *in = block + m_blockSize - count;
+    size_t n = m_re.size();
+    double *re = &m_re[0], *im = &m_im[0];
+    const double *c = &m_tables->twiddleCos[m_lo], *s = &m_tables->twiddleSin[m_lo];
+    for (size_t i = 0; i < count; ++i) {
+        double d = double(in[i]) - m_history[m_pos];
+        m_history[m_pos] = in[i];
+        if (++m_pos == m_blockSize) m_pos = 0;
+        // independent across bins, so this loop vectorises
+        for (size_t k = 0; k < n; ++k) {
+            double a = re[k] + d;
+            double b = im[k];
+            re[k] = a * c[k] - b * s[k];
+            im[k] = a * s[k] + b * c[k];
+        }
+    }
+
+    m_sinceResync += count;
+    if (m_sinceResync >= ResyncInterval) recompute();
+}
+
+/*
+ * Direct DFT of the history over the tracked bins, oldest sample first.
+ */
+void
+SlidingDFT::recompute()
+{
+    for (size_t i = 0; i < m_re.size(); ++i) {
+        // the phasor exp(-2 pi i k m / N), advanced by multiplication
+        double c = m_tables->twiddleCos[m_lo + i], s = -m_tables->twiddleSin[m_lo + i];
+        double pr = 1.0, pi = 0.0, sr = 0.0, si = 0.0;
+        for (size_t m = 0; m < m_blockSize; ++m) {
+            double x = m_history[(m_pos + m) % m_blockSize];
+            sr += x * pr;
+            si += x * pi;
+            double t = pr * c - pi * s;
+            pi = pr * s + pi * c;
+            pr = t;
+        }
+        m_re[i] = sr;
+        m_im[i] = si;
+    }
+    m_sinceResync = 0;
+}
+
+void
+SlidingDFT::getSpectrum(float *spectrum) const
+{
+    // Hann window as a convolution with (-1/4, 1/2, -1/4); the bins
+    // either side of 0 and blockSize/2 are conjugates of those inside
+    long half = m_blockSize/2;
+    for (size_t k = m_firstBin; k <= m_lastBin; ++k) {
+        long below = long(k) - 1, above = long(k) + 1;
+        double sign = 1.0;
+        if (below < 0) { below = 1; sign = -1.0; }
+        double br = m_re[below - m_lo], bi = sign * m_im[below - m_lo];
+        sign = 1.0;
+        if (above > half) { above = half - 1; sign = -1.0; }
+        double ar = m_re[above - m_lo], ai = sign * m_im[above - m_lo];
+        spectrum[k*2] = 0.5 * m_re[k - m_lo] - 0.25 * (br + ar);
+        spectrum[k*2 + 1] = 0.5 * m_im[k - m_lo] - 0.25 * (bi + ai);
+    }
+}
@@ -0,0 +1,81 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SlidingDFT -
+ * Recursive DFT of a sliding block of audio over a limited range of
+ * bins, updated sample by sample instead of recomputed per block.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_SLIDING_DFT_H_
+#define _BREGMAN_SLIDING_DFT_H_
+
+#include "SpectralTables.h"
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Bins firstBin..lastBin of the DFT of the last blockSize samples,
+ * maintained by the sliding DFT recursion
+ *
+ *   X_k <- (X_k + x[n] - x[n - blockSize]) * exp(2 pi i k / blockSize)
+ *
+ * at a cost per new sample proportional to the number of bins.  The
+ * state and twiddles (taken from the shared SpectralTables) are kept
+ * in double precision, and every
+ * ResyncInterval samples the bins are recomputed directly, so rounding
+ * errors cannot accumulate over long inputs.
+ *
+ * getSpectrum() applies a Hann window in the frequency domain, giving
+ * the magnitudes a Vamp host's windowed FFT would.
+ */
+
+class SlidingDFT
+{
+public:
+    static const size_t ResyncInterval = 1 << 20;
+
+    SlidingDFT();
+
+    /** Track bins firstBin..lastBin of the blocks tables describe. */
+    void initialise(const SharedSpectralTables &tables,
+                    size_t firstBin, size_t lastBin);
+    void reset();
+
+    /**
+     * Advance to the block of blockSize samples ending with the count
+     * samples of input.  If the previous block overlapped this one by
+     * blockSize - count samples, only the count new samples are
+     * processed; otherwise (on the first call, or when count is the
+     * whole block) the bins are computed directly.
+     */
+    void update(const float *block, size_t count);
+
+    /**
+     * The Hann-windowed spectrum as interleaved re/im pairs of bins
+     * 0..blockSize/2, of which only firstBin..lastBin are written.
+     */
+    void getSpectrum(float *spectrum) const;
+
+protected:
+    void recompute();
+
+    SharedSpectralTables m_tables;
+    size_t m_blockSize;
+    size_t m_firstBin;
+    size_t m_lastBin;
+    size_t m_lo;                   // bins tracked: the range, widened by
+    size_t m_hi;                   // one either side for the window
+    std::vector<double> m_re;
+    std::vector<double> m_im;
+    std::vector<float> m_history;  // the last blockSize samples, circular
+    size_t m_pos;                  // oldest sample in m_history
+    bool m_primed;
+    size_t m_sinceResync;
+};
+
+#endif
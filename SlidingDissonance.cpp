@@ -0,0 +1,88 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SlidingDissonance -
+ * A time-domain version of the Dissonance plugin that maintains the
+ * spectrum of the analysis range with a sliding DFT, for small hops
+ * over a limited band.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "SlidingDissonance.h"
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+SlidingDissonance::SlidingDissonance(float inputSampleRate) :
+    Dissonance(inputSampleRate)
+{
+}
+
+SlidingDissonance::~SlidingDissonance()
+{
+}
+
+string
+SlidingDissonance::getIdentifier() const
+{
+    return "slidingdissonance";
+}
+
+string
+SlidingDissonance::getName() const
+{
+    return "Sliding Dissonance";
+}
+
+string
+SlidingDissonance::getDescription() const
+{
+    return "Calculate the dissonance function of the spectrum of the input signal, updating the spectrum of the analysed band with a sliding DFT";
+}
+
+size_t
+SlidingDissonance::getPreferredStepSize() const {
+    return 256;
+}
+
+bool
+SlidingDissonance::initialise(size_t channels, size_t stepSize, size_t blockSize)
+{
+    if (!Dissonance::initialise(channels, stepSize, blockSize)) return false;
+
+    m_sdft.initialise(m_frontEnd.getTables(), m_frontEnd.getRangeStart(),
+                      m_frontEnd.getRangeEnd());
+    m_spectrum.assign(m_blockSize + 2, 0.0f);
+    m_centre = Vamp::RealTime::frame2RealTime
+        (m_blockSize/2, (unsigned int)(m_inputSampleRate + 0.5f));
+    return true;
+}
+
+void
+SlidingDissonance::reset()
+{
+    Dissonance::reset();
+    m_sdft.reset();
+}
+
+SlidingDissonance::FeatureSet
+SlidingDissonance::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
+{
+    if (m_stepSize == 0) {
+	cerr << "ERROR: SlidingDissonance::process: "
+	     << "SlidingDissonance has not been initialised"
+	     << endl;
+	return FeatureSet();
+    }
+    m_sdft.update(inputBuffers[0], m_stepSize);
+    m_sdft.getSpectrum(&m_spectrum[0]);
+
+    // Hosts stamp frequency-domain input with the centre of the block,
+    // so do the same for results to line up with Dissonance's
+    const float *spectra[1] = { &m_spectrum[0] };
+    return Dissonance::process(spectra, timestamp + m_centre);
+}
@@ -0,0 +1,55 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SlidingDissonance -
+ * A time-domain version of the Dissonance plugin that maintains the
+ * spectrum of the analysis range with a sliding DFT, for small hops
+ * over a limited band.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _SLIDING_DISSONANCE_PLUGIN_H_
+#define _SLIDING_DISSONANCE_PLUGIN_H_
+
+#include "Dissonance.h"
+#include "SlidingDFT.h"
+
+/**
+ * Dissonance taking time-domain input.  Rather than a full FFT per
+ * block, the bins the front end analyses (the minfreq..maxfreq band and
+ * its smoothing margins) are updated by a sliding DFT from the step
+ * size's worth of new samples in each block.  The cost per block is
+ * proportional to the step size times the number of bins, against
+ * blockSize log blockSize for an FFT, so this wins for small steps and
+ * narrow bands.  The output matches Dissonance on the same audio.
+ */
+
+class SlidingDissonance : public Dissonance
+{
+public:
+    SlidingDissonance(float inputSampleRate);
+    virtual ~SlidingDissonance();
+
+    bool initialise(size_t channels, size_t stepSize, size_t blockSize);
+    void reset();
+
+    InputDomain getInputDomain() const { return TimeDomain; }
+
+    std::string getIdentifier() const;
+    std::string getName() const;
+    std::string getDescription() const;
+    size_t getPreferredStepSize() const;
+
+    FeatureSet process(const float *const *inputBuffers,
+                       Vamp::RealTime timestamp);
+
+protected:
+    SlidingDFT m_sdft;
+    std::vector<float> m_spectrum;
+    Vamp::RealTime m_centre;          // half a block, see process()
+};
+
+#endif
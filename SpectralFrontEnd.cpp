@@ -0,0 +1,518 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SpectralFrontEnd -
+ * The per-frame spectral analysis shared by the Bregman plugins:
+ * magnitudes, zero-phase smoothing and peak picking over a band of
+ * frequency-domain bins.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "SpectralFrontEnd.h"
+#include "DenormalGuard.h"
+
+extern "C" {
+#include "iirfilter.h"
+}
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::vector;
+
+typedef std::pair<float, int> IdxSortPair;
+
+static bool IdxComparator ( const IdxSortPair& l, const IdxSortPair& r)
+    { return l.first < r.first; }
+
+static bool FreqComparator ( const FreqSortPair& l, const FreqSortPair& r)
+{ return l.first < r.first; }
+
+// quick and dirty Butterworth low-pass filter coefficients (from scipy, cutoff = 0.25)
+// b, a
+#define LPF_ORDER 11
+#define PEAK_GROUP 4       // bins compared at once by findPeaks()
+
+// Bins smoothed beyond each edge of a restricted analysis range, so that
+// the filter's start-up transient (below 1e-6 of its peak response after
+// this many samples) has died away by the time it reaches the range
+#define LPF_EDGE_MARGIN 128
+
+// Bins per tile of the single-frame analysis: a tile's spectrum,
+// magnitudes and smoothed values take 16 KB, and stay in L1 cache from
+// one stage to the next
+#define ANALYSIS_TILE 1024
+
+// Analysis ranges of at least this many bins are smoothed by apfilter(),
+// in segments filtered side by side (and across cores with OpenMP).
+// Its results differ from the serial filter's by rounding, so it is
+// kept to very large blocks, where the serial recurrence dominates
+#define PARALLEL_SMOOTH_BINS 65536
+
+static float lpf_coeffs[2][LPF_ORDER] =
+    {{1.10559099e-05,   1.10559099e-04,   4.97515946e-04,
+          1.32670919e-03,   2.32174108e-03,   2.78608930e-03,
+          2.32174108e-03,   1.32670919e-03,   4.97515946e-04,
+          1.10559099e-04,   1.10559099e-05},
+    {1.00000000e+00,  -4.98698526e+00,   1.19364368e+01,
+         -1.77423718e+01,   1.79732280e+01,  -1.28862417e+01,
+         6.59320221e+00,  -2.36909169e+00,   5.70632706e-01,
+         -8.30176785e-02,   5.52971437e-03}};
+
+const size_t SpectralFrontEnd::Lanes;
+const size_t SpectralFrontEnd::MaxDecimation;
+
+static FILTER *
+newLowPass()
+{
+    FILTER *lpf = (FILTER*) calloc(1,sizeof(FILTER));
+    lpf->numb = LPF_ORDER;
+    lpf->numa = LPF_ORDER; // Assume A[0]=1 and crop array
+    for(int i=0; i<lpf->numb; i++){
+	lpf->coeffs[i] = lpf_coeffs[0][i];
+    }
+    for(int i=1; i<lpf->numa; i++){ // Assume A[0]=1 and crop array
+        lpf->coeffs[lpf->numb+i-1] = lpf_coeffs[1][i];
+    }
+    ifilter(lpf);
+    return lpf;
+}
+
+/* Magnitude of bin i of an interleaved re/im spectrum, normalised by half */
+static inline float
+binMagnitude(const float *spectrum, size_t i, size_t half)
+{
+    double real = spectrum[i*2];
+    double imag = spectrum[i*2 + 1];
+    return sqrt(real * real + imag * imag) / half;
+}
+
+/*
+ * Bins i from..end-1 with smoothed[i-1] - smoothed[i-2] > thresh and
+ * smoothed[i] - smoothed[i-1] < -thresh, into peak_idx and peak_mag.
+ * Returns the count.
+ *
+ * Bins are compared PEAK_GROUP at a time into a bitmask, and hits are
+ * compressed into the output without branching on each bin: every bin
+ * of a group with any hit is written at the current end of the list,
+ * which only advances past hits.  The output arrays therefore need
+ * PEAK_GROUP entries of slack beyond the largest possible peak count.
+ */
+static size_t
+scanPeaks(const float *smoothed, const float *mags, size_t from, size_t end,
+          size_t *peak_idx, float *peak_mag)
+{
+    const float thresh = 1e-9f;
+    size_t npeaks = 0;
+    size_t i = from;
+
+#ifdef __SSE2__
+    const __m128 up = _mm_set1_ps(thresh);
+    const __m128 down = _mm_set1_ps(-thresh);
+    for (; i + PEAK_GROUP <= end; i += PEAK_GROUP) {
+        __m128 a = _mm_loadu_ps(smoothed + i - 2);
+        __m128 b = _mm_loadu_ps(smoothed + i - 1);
+        __m128 c = _mm_loadu_ps(smoothed + i);
+        __m128 hits = _mm_and_ps(_mm_cmpgt_ps(_mm_sub_ps(b, a), up),
+                                 _mm_cmplt_ps(_mm_sub_ps(c, b), down));
+        int mask = _mm_movemask_ps(hits);
+        if (!mask) continue;
+        for (size_t k = 0; k < PEAK_GROUP; ++k) {
+            peak_idx[npeaks] = i + k;
+            peak_mag[npeaks] = mags[i + k];
+            npeaks += (mask >> k) & 1;
+        }
+    }
+#endif
+
+    for (; i < end; ++i) {
+        int hit = (smoothed[i-1] - smoothed[i-2] > thresh) &
+                  (smoothed[i] - smoothed[i-1] < -thresh);
+        peak_idx[npeaks] = i;
+        peak_mag[npeaks] = mags[i];
+        npeaks += hit;
+    }
+    return npeaks;
+}
+
+SpectralFrontEnd::SpectralFrontEnd() :
+    m_sampleRate(0.0f),
+    m_blockSize(0),
+    m_loBin(0),
+    m_hiBin(0),
+    m_rangeStart(0),
+    m_rangeEnd(0),
+    m_decimation(1),
+    m_denormalFrames(0)
+{
+}
+
+void
+SpectralFrontEnd::setBand(float minFreq, float maxFreq)
+{
+    // bins searched for peaks, and the wider range that is smoothed
+    size_t half = m_blockSize/2;
+    m_loBin = std::min(half, size_t(floor(minFreq * m_blockSize / m_sampleRate)));
+    m_hiBin = std::min(half, size_t(ceil(maxFreq * m_blockSize / m_sampleRate)));
+    if (m_hiBin < m_loBin) m_hiBin = m_loBin;
+    m_rangeStart = (m_loBin > LPF_EDGE_MARGIN ? m_loBin - LPF_EDGE_MARGIN : 0);
+    m_rangeEnd = std::min(half, m_hiBin + LPF_EDGE_MARGIN);
+}
+
+void
+SpectralFrontEnd::setDecimation(size_t factor)
+{
+    m_decimation = std::max(size_t(1), std::min(factor, MaxDecimation));
+}
+
+void
+SpectralFrontEnd::initialise(float sampleRate, size_t blockSize,
+                             float minFreq, float maxFreq)
+{
+    m_sampleRate = sampleRate;
+    m_blockSize = blockSize;
+    m_tables.acquire(m_sampleRate, m_blockSize);
+    setBand(minFreq, maxFreq);
+
+    // room for a peak in every bin, plus the overrun of one findPeaks() group
+    size_t half = m_blockSize/2;
+    m_peakBins.resize(half + 1 + PEAK_GROUP);
+    m_peakMags.resize(half + 1 + PEAK_GROUP);
+    m_window.resize(2 * MaxDecimation + 5);
+
+    m_denormalFrames = 0;
+}
+
+/*
+ * Magnitudes of bins m_rangeStart..m_rangeEnd of an interleaved re/im
+ * spectrum, normalised by half the block size, and their sum.  Bins
+ * outside the range are not touched.
+ */
+void
+SpectralFrontEnd::computeMagnitudes(const float *spectrum, SpectralFrame &frame) const
+{
+    vector<float> &mags = frame.mags;
+    float energy = 0.0f;
+    mags.resize(m_blockSize/2 + 1);
+    mags[0] = 0;
+    for (size_t i = std::max(size_t(1), m_rangeStart); i <= m_rangeEnd; ++i) {
+	mags[i] = binMagnitude(spectrum, i, m_blockSize/2);
+        energy += mags[i];
+    }
+    frame.energy = energy;
+}
+
+/*
+ * Zero-phase low-pass smoothing of the magnitude spectrum followed by
+ * half-wave rectification.  On near-silent spectra the filter state
+ * decays into subnormals, so it runs with them flushed to zero, and
+ * counts the frames where that happened.
+ */
+void
+SpectralFrontEnd::analyse(const float *spectrum, SpectralFrame &frame)
+{
+    DenormalGuard guard;
+    frame.hasPeaks = false;
+    if (m_decimation <= 1) {
+        analyseTiled(spectrum, frame);
+        if (guard.flushed()) ++m_denormalFrames;
+        return;
+    }
+
+    computeMagnitudes(spectrum, frame);
+    vector<float> &mags = frame.mags;
+    vector<float> &smoothed = frame.smoothed;
+    FILTER *lpf = newLowPass();
+
+    // Low-pass filtering the spectrum backwards then forwards results in
+    // a linear-phase filter.  The backward pass runs down through memory
+    // and leaves its output in smoothed
+    size_t first = m_rangeStart, last = m_rangeEnd, len = last - first + 1;
+    smoothed.resize(m_blockSize/2 + 1);
+    lpf->in = &mags[last];
+    lpf->out = &smoothed[last];
+    arfilter(lpf, len); // backward filter
+
+    // forward filter, forming only the retained bins' outputs; the pole
+    // signal is kept so that getSmoothed() can form the rest
+    size_t count = (len - 1) / m_decimation + 1;
+    m_decimated.resize(count);
+    frame.poles.resize(len + lpf->ndelay);
+    lpf->in = &smoothed[first];
+    lpf->out = m_decimated.data();
+    adfilter(lpf, len, m_decimation, frame.poles.data());
+    for (size_t j = 0; j < count; ++j) {
+        float v = m_decimated[j];
+        smoothed[first + j*m_decimation] = (v < 0.0f ? 0.0f : v); // half-wave rectify
+    }
+    frame.decimation = m_decimation;
+
+    free_filter(lpf);
+    if (guard.flushed()) ++m_denormalFrames;
+}
+
+/*
+ * analyse() without decimation, as two passes over the analysis range
+ * in tiles of ANALYSIS_TILE bins: downwards, the magnitudes and the
+ * backward filter; upwards, the forward filter (in place), half-wave
+ * rectification, the energy sum and the peak scan of findPeaks().  The
+ * filter carries its state from tile to tile and the sums run in the
+ * same order as before, so the results are exactly those of each stage
+ * run over the whole range in turn, with each tile still in cache from
+ * one stage to the next.
+ *
+ * Ranges of PARALLEL_SMOOTH_BINS or more are instead smoothed in whole
+ * passes by apfilter(), before the upward pass does the rest.
+ */
+void
+SpectralFrontEnd::analyseTiled(const float *spectrum, SpectralFrame &frame) const
+{
+    size_t half = m_blockSize/2;
+    size_t first = m_rangeStart, last = m_rangeEnd;
+    vector<float> &mags = frame.mags;
+    vector<float> &smoothed = frame.smoothed;
+    mags.resize(half + 1);
+    smoothed.resize(half + 1);
+    frame.peakBins.resize(half + 1 + PEAK_GROUP);
+    frame.peakMags.resize(half + 1 + PEAK_GROUP);
+    mags[0] = 0;
+
+    FILTER *lpf = newLowPass();
+    const size_t len = last - first + 1;
+    const bool parallel = (len >= PARALLEL_SMOOTH_BINS);
+
+    if (parallel) {
+        for (size_t i = std::max(size_t(1), first); i <= last; ++i) {
+            mags[i] = binMagnitude(spectrum, i, half);
+        }
+        lpf->in = &mags[last];
+        lpf->out = &smoothed[last];
+        apfilter(lpf, len, -1); // backward filter
+        lpf->in = &smoothed[first];
+        lpf->out = &smoothed[first];
+        apfilter(lpf, len, 1); // forward filter
+    }
+
+    for (size_t hi = last + 1; hi > first && !parallel; ) {
+        size_t lo = (hi - first > ANALYSIS_TILE ? hi - ANALYSIS_TILE : first);
+        for (size_t i = std::max(size_t(1), lo); i < hi; ++i) {
+            mags[i] = binMagnitude(spectrum, i, half);
+        }
+        lpf->in = &mags[hi - 1];
+        lpf->out = &smoothed[hi - 1];
+        arfilter(lpf, hi - lo); // backward filter
+        hi = lo;
+    }
+
+    float energy = 0.0f;
+    size_t npeaks = 0;
+    size_t peakFrom = std::max(size_t(2), m_loBin), peakEnd = m_hiBin + 1;
+    for (size_t lo = first; lo <= last; lo += ANALYSIS_TILE) {
+        size_t hi = std::min(last + 1, lo + ANALYSIS_TILE);
+        if (!parallel) {
+            lpf->in = &smoothed[lo];
+            lpf->out = &smoothed[lo];
+            afilter(lpf, hi - lo); // forward filter
+        }
+        for (size_t i = lo; i < hi; ++i) {
+            if (smoothed[i] < 0.0f) smoothed[i] = 0.0f; // half-wave rectify
+        }
+        for (size_t i = std::max(size_t(1), lo); i < hi; ++i) {
+            energy += mags[i];
+        }
+        size_t from = std::max(peakFrom, lo), end = std::min(peakEnd, hi);
+        if (from < end) {
+            npeaks += scanPeaks(&smoothed[0], &mags[0], from, end,
+                                &frame.peakBins[npeaks], &frame.peakMags[npeaks]);
+        }
+    }
+
+    frame.energy = energy;
+    frame.decimation = 1;
+    frame.hasPeaks = true;
+    frame.peakLo = m_loBin;
+    frame.peakHi = m_hiBin;
+    frame.peakCount = npeaks;
+
+    free_filter(lpf);
+}
+
+void
+SpectralFrontEnd::analyse(const float *const *spectra, size_t count,
+                          SpectralFrame *frames)
+{
+    const size_t lanes = Lanes;
+    if (count > lanes) count = lanes;
+    if (m_decimation > 1) {
+        for (size_t l = 0; l < count; ++l) {
+            analyse(spectra[l], frames[l]);
+        }
+        return;
+    }
+
+    DenormalGuard guard;
+    size_t first = m_rangeStart, len = m_rangeEnd - m_rangeStart + 1;
+
+    for (size_t l = 0; l < count; ++l) {
+        computeMagnitudes(spectra[l], frames[l]);
+    }
+
+    FILTERBANK *bank = (FILTERBANK*) calloc(1, sizeof(FILTERBANK));
+    bank->numb = LPF_ORDER;
+    bank->numa = LPF_ORDER; // Assume A[0]=1 and crop array
+    bank->lanes = lanes;
+    for(int i=0; i<bank->numb; i++){
+	bank->coeffs[i] = lpf_coeffs[0][i];
+    }
+    for(int i=1; i<bank->numa; i++){ // Assume A[0]=1 and crop array
+        bank->coeffs[bank->numb+i-1] = lpf_coeffs[1][i];
+    }
+    ifilterbank(bank);
+
+    // Unused lanes are fed silence
+    vector<float> in(len * lanes, 0.0f), out(len * lanes);
+    for (size_t l = 0; l < count; ++l) {
+        for (size_t i = 0; i < len; ++i) {
+            in[i*lanes + l] = frames[l].mags[m_rangeEnd-i];
+        }
+    }
+    bank->in = in.data();
+    bank->out = out.data();
+    afilterbank(bank, len); // backward filter
+    for (size_t i = 0; i < len; ++i) {
+        for (size_t l = 0; l < lanes; ++l) {
+            in[i*lanes + l] = out[(len-1-i)*lanes + l];
+        }
+    }
+    afilterbank(bank, len); // forward filter
+
+    for (size_t l = 0; l < count; ++l) {
+        vector<float> &smoothed = frames[l].smoothed;
+        smoothed.resize(m_blockSize/2 + 1);
+        for (size_t i = 0; i < len; ++i) {
+            float v = out[i*lanes + l];
+            smoothed[first + i] = (v < 0.0f ? 0.0f : v); // half-wave rectify
+        }
+        frames[l].decimation = 1;
+        frames[l].hasPeaks = false;
+    }
+
+    free_filterbank(bank);
+    if (guard.flushed()) m_denormalFrames += count;
+}
+
+size_t
+SpectralFrontEnd::findPeaks(const SpectralFrame &frame)
+{
+    if (frame.decimation > 1) return findPeaksDecimated(frame);
+
+    if (frame.hasPeaks && frame.peakLo == m_loBin && frame.peakHi == m_hiBin) {
+        std::copy(frame.peakBins.begin(), frame.peakBins.begin() + frame.peakCount,
+                  m_peakBins.begin());
+        std::copy(frame.peakMags.begin(), frame.peakMags.begin() + frame.peakCount,
+                  m_peakMags.begin());
+        return frame.peakCount;
+    }
+    return scanPeaks(&frame.smoothed[0], &frame.mags[0],
+                     std::max(size_t(2), m_loBin), m_hiBin + 1,
+                     &m_peakBins[0], &m_peakMags[0]);
+}
+
+void
+SpectralFrontEnd::getSmoothed(const SpectralFrame &frame, size_t from, size_t to,
+                              float *values) const
+{
+    size_t d = frame.decimation;
+    // the pole signal is preceded by the filter's delay line on entry
+    size_t offset = frame.poles.size() - (m_rangeEnd - m_rangeStart + 1);
+    for (size_t i = from; i <= to; ++i) {
+        size_t k = i - m_rangeStart;
+        if (d <= 1 || k % d == 0) {
+            values[i - from] = frame.smoothed[i];
+        } else {
+            float v = afilterout(lpf_coeffs[0], LPF_ORDER, &frame.poles[offset + k]);
+            values[i - from] = (v < 0.0f ? 0.0f : v);
+        }
+    }
+}
+
+/*
+ * findPeaks() on a decimated smoothed spectrum.  Every local maximum of
+ * the full-resolution spectrum lies within one coarse interval of a
+ * maximum of the decimated one, so the bins around each coarse maximum
+ * are formed at full resolution and searched with the same detector.
+ */
+size_t
+SpectralFrontEnd::findPeaksDecimated(const SpectralFrame &frame)
+{
+    const size_t d = frame.decimation;
+    const float *smoothed = &frame.smoothed[0];
+    const float *mags = &frame.mags[0];
+    const float thresh = 1e-9f;
+    size_t first = m_rangeStart;
+    size_t count = (m_rangeEnd - first) / d + 1;    // coarse grid points
+    size_t lo = std::max(size_t(2), m_loBin), end = m_hiBin + 1;
+    size_t next = lo;                               // bins below are done
+    size_t npeaks = 0;
+
+    size_t j = std::max(size_t(1), (lo - first) / d);
+    j = (j > 1 ? j - 1 : 1);
+    for (; j + 1 < count && first + (j - 1) * d < end; ++j) {
+        float p = smoothed[first + (j - 1) * d];
+        float c = smoothed[first + j * d];
+        float n = smoothed[first + (j + 1) * d];
+        if (c < p || c < n || (c == p && c == n)) continue;
+
+        // a maximum between the neighbouring grid points gives a peak
+        // bin (one past the maximum) up to one beyond the next of them
+        size_t from = std::max(next, first + (j - 1) * d + 1);
+        size_t to = std::min(end - 1, first + (j + 1) * d + 1);
+        if (to > m_rangeEnd) to = m_rangeEnd;
+        if (from > to) continue;
+        float *s = &m_window[0];
+        getSmoothed(frame, from - 2, to, s);
+        for (size_t i = from; i <= to; ++i) {
+            const float *v = s + (i - from) + 2;
+            if ((v[-1] - v[-2] > thresh) && (v[0] - v[-1] < -thresh)) {
+                m_peakBins[npeaks] = i;
+                m_peakMags[npeaks] = mags[i];
+                ++npeaks;
+            }
+        }
+        next = to + 1;
+    }
+    return npeaks;
+}
+
+void
+SpectralFrontEnd::selectPartials(const size_t *bins, const float *mags, size_t count,
+                                 size_t maxPartials, vector<FreqSortPair> &freqs_mags,
+                                 vector<size_t> *partialBins) const
+{
+    freqs_mags.clear();
+    if (partialBins) partialBins->clear();
+    if (!count) return;
+
+    std::vector<IdxSortPair> arg_idx;
+    for(size_t i = 0; i < count; ++i){
+        arg_idx.push_back(IdxSortPair(mags[i], bins[i]));
+    }
+    // Reverse sorting by magnitude
+    std::sort(arg_idx.rbegin(), arg_idx.rend(), IdxComparator);
+    // Now grab the sorted list of freq, mags as a new pair
+    size_t num_partials = std::min(count, maxPartials);
+    for(size_t i = 0; i < num_partials; ++i){
+        freqs_mags.push_back(FreqSortPair(getBinFrequency(arg_idx[i].second),
+                                          arg_idx[i].first));
+        if (partialBins) partialBins->push_back(arg_idx[i].second);
+    }
+    std::sort(freqs_mags.begin(), freqs_mags.end(), FreqComparator); // sort by freq,mag pairs by ascending frequencies
+}
@@ -0,0 +1,175 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SpectralFrontEnd -
+ * The per-frame spectral analysis shared by the Bregman plugins:
+ * magnitudes, zero-phase smoothing and peak picking over a band of
+ * frequency-domain bins.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_SPECTRAL_FRONT_END_H_
+#define _BREGMAN_SPECTRAL_FRONT_END_H_
+
+#include "SpectralTables.h"
+
+#include <stddef.h>
+#include <vector>
+
+/* A spectral partial: (frequency in Hz, linear magnitude) */
+typedef std::pair<float,float> FreqSortPair;
+
+/* Largest useful analysis frequency: Nyquist at 96 kHz, i.e. no limit */
+#define MAX_ANALYSIS_FREQ 48000.0f
+
+/**
+ * Front-end results for one frame.  Vectors are indexed by bin
+ * (0..blockSize/2) but only hold values over the front end's analysis
+ * range, getRangeStart()..getRangeEnd().
+ */
+struct SpectralFrame
+{
+    SpectralFrame() : energy(0.0f), decimation(1), hasPeaks(false),
+                      peakLo(0), peakHi(0), peakCount(0) { }
+
+    std::vector<float> mags;     // magnitudes, normalised by blockSize/2
+    std::vector<float> smoothed; // low-passed, half-wave rectified mags
+    float energy;                // sum of mags over the range
+
+    // With decimated smoothing, smoothed only holds every decimation'th
+    // bin from getRangeStart(); the others are formed on demand from the
+    // smoothing filter's pole signal (see SpectralFrontEnd::getSmoothed)
+    size_t decimation;
+    std::vector<float> poles;
+
+    // Peaks between bins peakLo and peakHi, if hasPeaks: found while
+    // smoothing, for SpectralFrontEnd::findPeaks() to return
+    bool hasPeaks;
+    size_t peakLo;
+    size_t peakHi;
+    size_t peakCount;
+    std::vector<size_t> peakBins;
+    std::vector<float> peakMags;
+};
+
+class SpectralFrontEnd
+{
+public:
+    /** Frames smoothed side by side by analyse(spectra, count, ...) */
+    static const size_t Lanes = 8;
+
+    /** Largest smoothing decimation factor the filter's bandwidth allows */
+    static const size_t MaxDecimation = 4;
+
+    SpectralFrontEnd();
+
+    /**
+     * Prepare for blocks of blockSize samples at sampleRate.  Peaks are
+     * sought between minFreq and maxFreq; magnitudes and smoothing
+     * cover that band plus a margin either side, in which the smoothing
+     * filter's start-up transient dies away.
+     */
+    void initialise(float sampleRate, size_t blockSize,
+                    float minFreq = 0.0f, float maxFreq = MAX_ANALYSIS_FREQ);
+
+    /**
+     * Move the band searched for peaks, keeping everything else set up
+     * by initialise().  Frames analysed before the change must not be
+     * passed to findPeaks() or getSmoothed() after it.
+     */
+    void setBand(float minFreq, float maxFreq);
+
+    float getSampleRate() const { return m_sampleRate; }
+    size_t getBlockSize() const { return m_blockSize; }
+    size_t getLoBin() const { return m_loBin; }   // bins searched for peaks
+    size_t getHiBin() const { return m_hiBin; }
+    size_t getRangeStart() const { return m_rangeStart; } // bins analysed
+    size_t getRangeEnd() const { return m_rangeEnd; }
+    float getBinFrequency(size_t bin) const { return m_tables->binFreqs[bin]; }
+
+    /** Tables shared with other instances of the same configuration. */
+    const SharedSpectralTables &getTables() const { return m_tables; }
+
+    /**
+     * Compute only every factor'th bin of the smoothed spectrum (1, the
+     * default, computes all of them; at most MaxDecimation).  The
+     * smoothing filter's cutoff is a quarter of the bin rate's Nyquist
+     * frequency, so the smoothed spectrum is about 4x oversampled.
+     * Peaks are located on the decimated grid and refined to the full
+     * resolution bin.  Maxima closer together than about factor bins
+     * are not all resolved, so weak peaks may be missed.
+     */
+    void setDecimation(size_t factor);
+    size_t getDecimation() const { return m_decimation; }
+
+    /**
+     * Magnitudes and smoothing of an interleaved re/im spectrum.
+     * Without decimation, the peaks are found at the same time.
+     */
+    void analyse(const float *spectrum, SpectralFrame &frame);
+
+    /**
+     * analyse() for count (at most Lanes) spectra at once, smoothing
+     * them in the lanes of a FILTERBANK.  Results are identical.  With
+     * decimation the frames are analysed one at a time.
+     */
+    void analyse(const float *const *spectra, size_t count, SpectralFrame *frames);
+
+    /**
+     * Smoothed values of bins from..to (within the analysis range) of
+     * frame, whether or not its smoothing was decimated.
+     */
+    void getSmoothed(const SpectralFrame &frame, size_t from, size_t to,
+                     float *values) const;
+
+    /**
+     * Spectral derivative zero crossings of frame.smoothed between
+     * getLoBin() and getHiBin(), in ascending order, or those found by
+     * analyse() for the same band.  Returns the count;
+     * the bins and their unsmoothed magnitudes are in getPeakBins() and
+     * getPeakMags() until the next call.
+     */
+    size_t findPeaks(const SpectralFrame &frame);
+    const size_t *getPeakBins() const { return &m_peakBins[0]; }
+    const float *getPeakMags() const { return &m_peakMags[0]; }
+
+    /**
+     * The maxPartials strongest of count peaks, as partials sorted by
+     * ascending frequency.  If partialBins is non-null it receives the
+     * bins of the partials, strongest first.
+     */
+    void selectPartials(const size_t *bins, const float *mags, size_t count,
+                        size_t maxPartials, std::vector<FreqSortPair> &partials,
+                        std::vector<size_t> *partialBins = 0) const;
+
+    /**
+     * Frames whose smoothing produced subnormal values (flushed to
+     * zero).  Frames smoothed together are counted together.
+     */
+    size_t getDenormalFrameCount() const { return m_denormalFrames; }
+    void resetDenormalFrameCount() { m_denormalFrames = 0; }
+
+protected:
+    void computeMagnitudes(const float *spectrum, SpectralFrame &frame) const;
+    void analyseTiled(const float *spectrum, SpectralFrame &frame) const;
+    size_t findPeaksDecimated(const SpectralFrame &frame);
+
+    float m_sampleRate;
+    size_t m_blockSize;
+    SharedSpectralTables m_tables;
+    size_t m_loBin;
+    size_t m_hiBin;
+    size_t m_rangeStart;
+    size_t m_rangeEnd;
+    std::vector<size_t> m_peakBins;
+    std::vector<float> m_peakMags;
+    size_t m_decimation;
+    std::vector<float> m_decimated;  // decimated smoothing output
+    std::vector<float> m_window;     // full-resolution values around a peak
+    size_t m_denormalFrames;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SpectralTables -
+ * Read-only per-configuration tables (frequency axis, pitch classes,
+ * DFT twiddles), shared by every plugin instance with the same sample
+ * rate and block size.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "SpectralTables.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <map>
+
+namespace {
+
+typedef std::pair<float, size_t> TablesKey;
+
+struct CacheEntry {
+    SpectralTables *tables;
+    size_t refs;
+};
+
+typedef std::map<TablesKey, CacheEntry> TablesCache;
+
+pthread_mutex_t cacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// created on first use, so that no static constructor runs at load time
+TablesCache *cache = 0;
+
+SpectralTables *
+buildTables(float sampleRate, size_t blockSize)
+{
+    SpectralTables *t = new SpectralTables;
+    t->sampleRate = sampleRate;
+    t->blockSize = blockSize;
+
+    size_t bins = blockSize/2 + 1;
+    t->binFreqs.resize(bins);
+    t->chromaBins.assign(bins, -1);
+    t->twiddleCos.resize(bins);
+    t->twiddleSin.resize(bins);
+    for (size_t i = 0; i < bins; ++i) {
+        float freq = (double(i) * sampleRate) / blockSize;
+        t->binFreqs[i] = freq;
+        if (i > 0 && freq >= CHROMA_MIN_FREQ) {
+            // pitch class, A4 = 440 Hz
+            int semitone = int(floor(12.0 * log(freq / 440.0) / log(2.0) + 0.5)) + 9;
+            t->chromaBins[i] = ((semitone % 12) + 12) % 12;
+        }
+        double w = 2.0 * M_PI * double(i) / blockSize;
+        t->twiddleCos[i] = cos(w);
+        t->twiddleSin[i] = sin(w);
+    }
+    return t;
+}
+
+}
+
+SharedSpectralTables::SharedSpectralTables(const SharedSpectralTables &other) :
+    m_tables(0)
+{
+    *this = other;
+}
+
+SharedSpectralTables &
+SharedSpectralTables::operator=(const SharedSpectralTables &other)
+{
+    if (other.m_tables == m_tables) return *this;
+    release();
+    if (other.m_tables) {
+        pthread_mutex_lock(&cacheMutex);
+        TablesKey key(other.m_tables->sampleRate, other.m_tables->blockSize);
+        ++(*cache)[key].refs;
+        m_tables = other.m_tables;
+        pthread_mutex_unlock(&cacheMutex);
+    }
+    return *this;
+}
+
+SharedSpectralTables::~SharedSpectralTables()
+{
+    release();
+}
+
+void
+SharedSpectralTables::acquire(float sampleRate, size_t blockSize)
+{
+    if (m_tables && m_tables->sampleRate == sampleRate &&
+        m_tables->blockSize == blockSize) return;
+    release();
+
+    pthread_mutex_lock(&cacheMutex);
+    if (!cache) cache = new TablesCache;
+    TablesKey key(sampleRate, blockSize);
+    TablesCache::iterator i = cache->find(key);
+    if (i == cache->end()) {
+        CacheEntry entry;
+        entry.tables = buildTables(sampleRate, blockSize);
+        entry.refs = 0;
+        i = cache->insert(TablesCache::value_type(key, entry)).first;
+    }
+    ++i->second.refs;
+    m_tables = i->second.tables;
+    pthread_mutex_unlock(&cacheMutex);
+}
+
+void
+SharedSpectralTables::release()
+{
+    if (!m_tables) return;
+
+    pthread_mutex_lock(&cacheMutex);
+    TablesKey key(m_tables->sampleRate, m_tables->blockSize);
+    TablesCache::iterator i = cache->find(key);
+    if (i != cache->end() && --i->second.refs == 0) {
+        delete i->second.tables;
+        cache->erase(i);
+    }
+    pthread_mutex_unlock(&cacheMutex);
+    m_tables = 0;
+}
+
+size_t
+SharedSpectralTables::getCacheSize()
+{
+    pthread_mutex_lock(&cacheMutex);
+    size_t size = (cache ? cache->size() : 0);
+    pthread_mutex_unlock(&cacheMutex);
+    return size;
+}
@@ -0,0 +1,71 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SpectralTables -
+ * Read-only per-configuration tables (frequency axis, pitch classes,
+ * DFT twiddles), shared by every plugin instance with the same sample
+ * rate and block size.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_SPECTRAL_TABLES_H_
+#define _BREGMAN_SPECTRAL_TABLES_H_
+
+#include <stddef.h>
+#include <vector>
+
+/* Bins below this frequency (A0) are too coarse to assign a pitch class */
+#define CHROMA_MIN_FREQ 27.5f
+
+/**
+ * Tables over bins 0..blockSize/2 of blockSize-sample blocks at
+ * sampleRate.  Never modified once built.
+ */
+struct SpectralTables
+{
+    float sampleRate;
+    size_t blockSize;
+    std::vector<float> binFreqs;     // centre frequency of each bin, Hz
+    std::vector<int> chromaBins;     // pitch class of each bin (C = 0), -1 if none
+    std::vector<double> twiddleCos;  // exp(2 pi i k / blockSize) of each bin
+    std::vector<double> twiddleSin;
+};
+
+/**
+ * A counted reference to the SpectralTables for one configuration.
+ *
+ * Tables live in a process-wide cache: the first reference to a sample
+ * rate and block size builds them, later ones share them, and they are
+ * freed with the last reference.  References may be taken, copied and
+ * dropped from any thread.  A default-constructed reference holds
+ * nothing and costs nothing, so plugins only pay for tables once
+ * initialised, not when a host instantiates them to read metadata.
+ */
+
+class SharedSpectralTables
+{
+public:
+    SharedSpectralTables() : m_tables(0) { }
+    SharedSpectralTables(const SharedSpectralTables &other);
+    SharedSpectralTables &operator=(const SharedSpectralTables &other);
+    ~SharedSpectralTables();
+
+    /** Refer to the tables for sampleRate and blockSize. */
+    void acquire(float sampleRate, size_t blockSize);
+    void release();
+
+    bool isValid() const { return m_tables != 0; }
+    const SpectralTables &operator*() const { return *m_tables; }
+    const SpectralTables *operator->() const { return m_tables; }
+
+    /** Configurations currently held in the cache. */
+    static size_t getCacheSize();
+
+protected:
+    const SpectralTables *m_tables;
+};
+
+#endif
@@ -0,0 +1,225 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SpectrogramFile -
+ * Read-only, memory-mapped access to precomputed spectrograms, stored
+ * either as NumPy .npy arrays or as raw float32 with a small header,
+ * so that the batch tools can run Dissonance without an FFT.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "SpectrogramFile.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using std::string;
+
+#define NPY_MAGIC "\x93NUMPY"
+#define NPY_MAGIC_LEN 6
+
+SpectrogramFile::SpectrogramFile() :
+    m_base(0),
+    m_size(0),
+    m_data(0),
+    m_sampleRate(0),
+    m_stepSize(0),
+    m_blockSize(0),
+    m_frameCount(0),
+    m_complex(false)
+{
+}
+
+SpectrogramFile::~SpectrogramFile()
+{
+    close();
+}
+
+bool
+SpectrogramFile::recognise(string path)
+{
+    char magic[8];
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    size_t n = fread(magic, 1, sizeof(magic), fp);
+    fclose(fp);
+    return (n == sizeof(magic) && !memcmp(magic, SPECTROGRAM_FILE_MAGIC, sizeof(magic))) ||
+        (n >= NPY_MAGIC_LEN && !memcmp(magic, NPY_MAGIC, NPY_MAGIC_LEN));
+}
+
+bool
+SpectrogramFile::open(string path, float sampleRate, size_t stepSize)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        m_error = "cannot open \"" + path + "\": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SpectrogramFileHeader)) {
+        m_error = "\"" + path + "\" is too short to be a spectrogram";
+        ::close(fd);
+        return false;
+    }
+    void *base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        m_error = "cannot map \"" + path + "\": " + strerror(errno);
+        return false;
+    }
+    m_base = base;
+    m_size = st.st_size;
+
+    const unsigned char *p = (const unsigned char *)m_base;
+    size_t bytes;
+    if (!memcmp(p, NPY_MAGIC, NPY_MAGIC_LEN)) {
+        if (sampleRate <= 0 || stepSize == 0) {
+            m_error = "no sample rate and step given for \"" + path + "\"";
+            close();
+            return false;
+        }
+        if (!parseNpy(p, m_size)) {
+            m_error = "\"" + path + "\" is not a (frames, bins) float32 or complex64 array";
+            close();
+            return false;
+        }
+        m_sampleRate = sampleRate;
+        m_stepSize = stepSize;
+        bytes = (const unsigned char *)m_data - p;
+    } else {
+        const SpectrogramFileHeader *header = (const SpectrogramFileHeader *)m_base;
+        if (strncmp(header->magic, SPECTROGRAM_FILE_MAGIC, sizeof(header->magic))) {
+            m_error = "\"" + path + "\" is not a spectrogram";
+            close();
+            return false;
+        }
+        if (header->formatVersion != SPECTROGRAM_FILE_VERSION) {
+            m_error = "\"" + path + "\" has an unsupported format version";
+            close();
+            return false;
+        }
+        if (header->blockSize < 2 || header->stepSize == 0 || header->sampleRate <= 0) {
+            m_error = "\"" + path + "\" has a bad header";
+            close();
+            return false;
+        }
+        m_sampleRate = header->sampleRate;
+        m_stepSize = header->stepSize;
+        m_blockSize = header->blockSize;
+        m_frameCount = header->frameCount;
+        m_complex = (header->complex != 0);
+        m_data = (const float *)(header + 1);
+        bytes = sizeof(SpectrogramFileHeader);
+    }
+
+    if (m_blockSize & (m_blockSize - 1)) {
+        m_error = "\"" + path + "\" does not have a power of two block size";
+        close();
+        return false;
+    }
+    size_t frameFloats = (m_blockSize / 2 + 1) * (m_complex ? 2 : 1);
+    if (uint64_t(m_frameCount) * frameFloats * sizeof(float) > m_size - bytes) {
+        m_error = "\"" + path + "\" is truncated";
+        close();
+        return false;
+    }
+
+    // Chunks run through their frame ranges in order
+    madvise(m_base, m_size, MADV_SEQUENTIAL);
+
+    m_error = "";
+    return true;
+}
+
+/*
+ * Parse just enough of a .npy header (format versions 1 to 3) to find
+ * a C-order, two-dimensional, little-endian float32 or complex64 array.
+ */
+bool
+SpectrogramFile::parseNpy(const unsigned char *p, size_t size)
+{
+    int major = p[NPY_MAGIC_LEN];
+    size_t headerLen, start;
+    if (major == 1) {
+        headerLen = p[8] | (p[9] << 8);
+        start = 10;
+    } else if (major == 2 || major == 3) {
+        headerLen = p[8] | (p[9] << 8) | (p[10] << 16) | (size_t(p[11]) << 24);
+        start = 12;
+    } else {
+        return false;
+    }
+    if (start + headerLen > size) return false;
+    string header((const char *)p + start, headerLen);
+
+    string::size_type descr = header.find("'descr'");
+    string::size_type order = header.find("'fortran_order'");
+    string::size_type shape = header.find("'shape'");
+    if (descr == string::npos || order == string::npos || shape == string::npos) {
+        return false;
+    }
+
+    string::size_type quote = header.find('\'', header.find(':', descr));
+    if (quote == string::npos) return false;
+    string type = header.substr(quote + 1, 3);
+    if (type == "<f4") m_complex = false;
+    else if (type == "<c8") m_complex = true;
+    else return false;
+
+    string::size_type value = header.find_first_not_of(' ', header.find(':', order) + 1);
+    if (value == string::npos || header.compare(value, 5, "False")) return false;
+
+    unsigned long frames, bins;
+    string::size_type paren = header.find('(', shape);
+    if (paren == string::npos ||
+        sscanf(header.c_str() + paren, "(%lu ,%lu )", &frames, &bins) != 2 ||
+        bins < 2) {
+        return false;
+    }
+
+    m_frameCount = frames;
+    m_blockSize = 2 * (bins - 1);
+    m_data = (const float *)(p + start + headerLen);
+    return (start + headerLen) % sizeof(float) == 0;
+}
+
+void
+SpectrogramFile::close()
+{
+    if (m_base) {
+        munmap(m_base, m_size);
+    }
+    m_base = 0;
+    m_size = 0;
+    m_data = 0;
+    m_sampleRate = 0;
+    m_stepSize = 0;
+    m_blockSize = 0;
+    m_frameCount = 0;
+    m_complex = false;
+}
+
+const float *
+SpectrogramFile::getFrame(size_t frame, float *buffer) const
+{
+    const size_t bins = m_blockSize / 2 + 1;
+    if (m_complex) return m_data + frame * bins * 2;
+
+    const float *mags = m_data + frame * bins;
+    for (size_t i = 0; i < bins; ++i) {
+        buffer[i * 2] = mags[i];
+        buffer[i * 2 + 1] = 0.0f;
+    }
+    return buffer;
+}
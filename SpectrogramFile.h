@@ -0,0 +1,99 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SpectrogramFile -
+ * Read-only, memory-mapped access to precomputed spectrograms, stored
+ * either as NumPy .npy arrays or as raw float32 with a small header,
+ * so that the batch tools can run Dissonance without an FFT.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_SPECTROGRAM_FILE_H_
+#define _BREGMAN_SPECTROGRAM_FILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * A spectrogram holds frameCount frames of blockSize/2 + 1 bins, frame
+ * k being the spectrum of the Hann-windowed block starting at sample
+ * k * stepSize, on the scale of an unnormalised FFT (as a Vamp host
+ * passes to a FrequencyDomain plugin).  Each bin is either a magnitude
+ * or a re, im pair.  All values are little-endian float32.
+ *
+ * Raw files are laid out as
+ *
+ *   SpectrogramFileHeader                  64 bytes
+ *   frame 0 bins, frame 1 bins, ...
+ *
+ * .npy files hold a C-order array of shape (frames, bins) with dtype
+ * '<f4' (magnitudes) or '<c8' (complex); they carry no sample rate or
+ * step, which must be supplied to open().
+ */
+
+#define SPECTROGRAM_FILE_MAGIC "BRGSPEC"
+#define SPECTROGRAM_FILE_VERSION 1
+
+struct SpectrogramFileHeader
+{
+    char magic[8];              /* SPECTROGRAM_FILE_MAGIC, NUL-terminated */
+    uint32_t formatVersion;     /* SPECTROGRAM_FILE_VERSION */
+    uint32_t complex;           /* 1 for re, im pairs, 0 for magnitudes */
+    uint64_t frameCount;        /* frames in the file */
+    float sampleRate;           /* sample rate of the analysed audio */
+    uint32_t stepSize;          /* hop in samples between frames */
+    uint32_t blockSize;         /* FFT length; bins = blockSize/2 + 1 */
+    char reserved[28];
+};
+
+class SpectrogramFile
+{
+public:
+    SpectrogramFile();
+    virtual ~SpectrogramFile();
+
+    /** True if path starts with the raw or .npy magic number. */
+    static bool recognise(std::string path);
+
+    /**
+     * Open path.  sampleRate and stepSize describe .npy files and are
+     * ignored for raw files, whose header gives them.
+     */
+    bool open(std::string path, float sampleRate = 0, size_t stepSize = 0);
+    void close();
+    bool isOpen() const { return m_base != 0; }
+    std::string getError() const { return m_error; }
+
+    float getSampleRate() const { return m_sampleRate; }
+    size_t getStepSize() const { return m_stepSize; }
+    size_t getBlockSize() const { return m_blockSize; }
+    size_t getFrameCount() const { return m_frameCount; }
+    bool isComplex() const { return m_complex; }
+
+    /**
+     * Frame as the blockSize + 2 interleaved re, im floats of a Vamp
+     * frequency-domain input.  Complex frames are returned in place;
+     * magnitudes are written to buffer as real values, which leaves
+     * every bin's magnitude unchanged.
+     */
+    const float *getFrame(size_t frame, float *buffer) const;
+
+protected:
+    bool parseNpy(const unsigned char *p, size_t size);
+
+    void *m_base;
+    size_t m_size;
+    const float *m_data;
+    float m_sampleRate;
+    size_t m_stepSize;
+    size_t m_blockSize;
+    size_t m_frameCount;
+    bool m_complex;
+    std::string m_error;
+};
+
+#endif
@@ -0,0 +1,75 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * StreamProtocol -
+ * Wire format between bregman-daemon and its clients.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_STREAM_PROTOCOL_H_
+#define _BREGMAN_STREAM_PROTOCOL_H_
+
+#include <stdint.h>
+
+/*
+ * A client connects to the daemon's Unix domain socket and sends one
+ * StreamRequest, then interleaved float32 PCM at the stated channel
+ * count, and finally shuts down its sending side to mark the end of
+ * the stream.  The daemon answers with one StreamReply and, if the
+ * status is 0, one StreamResult per analysis frame as soon as it is
+ * computed, closing the connection after the last frame.
+ *
+ * Frame k covers samples [k * stepSize, k * stepSize + blockSize) of
+ * the mixed-down stream, zero-padded past its end, as in bregman-batch.
+ * All fields are in host byte order, since both ends share a machine.
+ */
+
+#define STREAM_MAGIC 0x53475242         /* "BRGS" */
+#define STREAM_VERSION 1
+#define STREAM_DEFAULT_SOCKET "/tmp/bregman-daemon.sock"
+
+struct StreamRequest
+{
+    uint32_t magic;             /* STREAM_MAGIC */
+    uint32_t version;           /* STREAM_VERSION */
+    float sampleRate;
+    uint32_t channels;
+    uint32_t stepSize;          /* 0 for the plugin's preferred step */
+    uint32_t blockSize;         /* 0 for the plugin's preferred block */
+};
+
+struct StreamReply
+{
+    uint32_t magic;             /* STREAM_MAGIC */
+    int32_t status;             /* 0, or a STREAM_ERROR_ code */
+    uint32_t stepSize;          /* as used by the daemon */
+    uint32_t blockSize;
+};
+
+#define STREAM_ERROR_PROTOCOL -1        /* bad magic or version, or the
+                                           request did not arrive in time */
+#define STREAM_ERROR_PARAMETERS -2      /* out of range, or plugin rejected
+                                           the sizes */
+#define STREAM_ERROR_RESOURCES -3       /* daemon could not allocate the
+                                           stream */
+
+/* Largest sample rate, channel count and block size a daemon accepts. */
+#define STREAM_MAX_SAMPLE_RATE 384000
+#define STREAM_MAX_CHANNELS 64
+#define STREAM_MAX_BLOCK_SIZE 262144
+
+struct StreamResult
+{
+    uint64_t frame;
+    double time;                /* seconds from the start of the stream */
+    float dissonance;           /* NaN if the frame had no value */
+    float latency;              /* ms from the arrival of the frame's last
+                                   sample to this result being sent */
+    uint32_t backlog;           /* samples received but not yet analysed */
+    uint32_t reserved;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SummaryStats -
+ * Constant-space running statistics of a stream of values.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "SummaryStats.h"
+
+#include <algorithm>
+
+const size_t SummaryStats::QuantileCount;
+const size_t SummaryStats::ValueCount;
+const double SummaryStats::Quantiles[SummaryStats::QuantileCount] =
+    { 0.1, 0.25, 0.5, 0.75, 0.9 };
+
+P2Quantile::P2Quantile(double p) :
+    m_p(p)
+{
+    reset();
+}
+
+void
+P2Quantile::reset()
+{
+    m_count = 0;
+    for (int i = 0; i < 5; ++i) {
+        m_q[i] = 0.0;
+        m_n[i] = i;
+    }
+    m_np[0] = 0;
+    m_np[1] = 2 * m_p;
+    m_np[2] = 4 * m_p;
+    m_np[3] = 2 + 2 * m_p;
+    m_np[4] = 4;
+    m_dn[0] = 0;
+    m_dn[1] = m_p / 2;
+    m_dn[2] = m_p;
+    m_dn[3] = (1 + m_p) / 2;
+    m_dn[4] = 1;
+}
+
+double
+P2Quantile::parabolic(int i, int d) const
+{
+    return m_q[i] + d / (m_n[i+1] - m_n[i-1]) *
+        ((m_n[i] - m_n[i-1] + d) * (m_q[i+1] - m_q[i]) / (m_n[i+1] - m_n[i]) +
+         (m_n[i+1] - m_n[i] - d) * (m_q[i] - m_q[i-1]) / (m_n[i] - m_n[i-1]));
+}
+
+double
+P2Quantile::linear(int i, int d) const
+{
+    return m_q[i] + d * (m_q[i+d] - m_q[i]) / (m_n[i+d] - m_n[i]);
+}
+
+void
+P2Quantile::add(double x)
+{
+    if (m_count < 5) {
+        m_q[m_count++] = x;
+        std::sort(m_q, m_q + m_count);
+        return;
+    }
+
+    // find the cell containing x, extending the extremes if need be
+    int k;
+    if (x < m_q[0]) {
+        m_q[0] = x;
+        k = 0;
+    } else if (x >= m_q[4]) {
+        m_q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= m_q[k+1]) ++k;
+    }
+    for (int i = k + 1; i < 5; ++i) m_n[i] += 1;
+    for (int i = 0; i < 5; ++i) m_np[i] += m_dn[i];
+    ++m_count;
+
+    // nudge the middle markers towards their desired positions
+    for (int i = 1; i <= 3; ++i) {
+        double d = m_np[i] - m_n[i];
+        if ((d >= 1 && m_n[i+1] - m_n[i] > 1) ||
+            (d <= -1 && m_n[i-1] - m_n[i] < -1)) {
+            int s = (d > 0 ? 1 : -1);
+            double q = parabolic(i, s);
+            if (!(m_q[i-1] < q && q < m_q[i+1])) q = linear(i, s);
+            m_q[i] = q;
+            m_n[i] += s;
+        }
+    }
+}
+
+double
+P2Quantile::get() const
+{
+    if (m_count == 0) return 0.0;
+    if (m_count <= 5) {
+        // exact, by nearest rank
+        size_t i = size_t(m_p * (m_count - 1) + 0.5);
+        return m_q[i];
+    }
+    return m_q[2];
+}
+
+SummaryStats::SummaryStats()
+{
+    for (size_t i = 0; i < QuantileCount; ++i) {
+        m_quantiles[i] = P2Quantile(Quantiles[i]);
+    }
+    reset();
+}
+
+void
+SummaryStats::reset()
+{
+    m_count = 0;
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    m_min = 0.0;
+    m_max = 0.0;
+    for (size_t i = 0; i < QuantileCount; ++i) {
+        m_quantiles[i].reset();
+    }
+}
+
+void
+SummaryStats::add(double x)
+{
+    if (m_count == 0) {
+        m_min = m_max = x;
+    } else {
+        m_min = std::min(m_min, x);
+        m_max = std::max(m_max, x);
+    }
+    ++m_count;
+    double delta = x - m_mean;
+    m_mean += delta / m_count;
+    m_m2 += delta * (x - m_mean);
+    for (size_t i = 0; i < QuantileCount; ++i) {
+        m_quantiles[i].add(x);
+    }
+}
+
+double
+SummaryStats::getVariance() const
+{
+    return (m_count > 1 ? m_m2 / (m_count - 1) : 0.0);
+}
+
+void
+SummaryStats::getValues(std::vector<float> &values) const
+{
+    values.clear();
+    values.push_back(m_count);
+    values.push_back(m_mean);
+    values.push_back(getVariance());
+    values.push_back(m_min);
+    values.push_back(m_max);
+    for (size_t i = 0; i < QuantileCount; ++i) {
+        values.push_back(m_quantiles[i].get());
+    }
+}
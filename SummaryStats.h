@@ -0,0 +1,82 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * SummaryStats -
+ * Constant-space running statistics of a stream of values.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_SUMMARY_STATS_H_
+#define _BREGMAN_SUMMARY_STATS_H_
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Streaming estimate of one quantile by the P-squared algorithm (Jain
+ * and Chlamtac, CACM 28(10), 1985): five markers whose heights are
+ * adjusted by piecewise-parabolic interpolation as values arrive.
+ * Exact for up to five values.
+ */
+
+class P2Quantile
+{
+public:
+    P2Quantile(double p = 0.5);
+
+    void reset();
+    void add(double x);
+    double get() const;
+
+protected:
+    double parabolic(int i, int d) const;
+    double linear(int i, int d) const;
+
+    double m_p;
+    size_t m_count;
+    double m_q[5];              // marker heights
+    double m_n[5];              // marker positions
+    double m_np[5];             // desired marker positions
+    double m_dn[5];             // desired position increments
+};
+
+/**
+ * Count, mean, variance, extrema and a fixed set of quantiles of the
+ * values added since the last reset(), in constant space.
+ */
+
+class SummaryStats
+{
+public:
+    SummaryStats();
+
+    void reset();
+    void add(double x);
+
+    size_t getCount() const { return m_count; }
+    double getMean() const { return m_mean; }
+    double getVariance() const; // unbiased; 0 for fewer than two values
+    double getMin() const { return m_min; }
+    double getMax() const { return m_max; }
+
+    static const size_t QuantileCount = 5;
+    static const double Quantiles[QuantileCount]; // 0.1 .. 0.9
+    double getQuantile(size_t i) const { return m_quantiles[i].get(); }
+
+    /** Count, mean, variance, min, max, then the quantiles. */
+    void getValues(std::vector<float> &values) const;
+    static const size_t ValueCount = 5 + QuantileCount;
+
+protected:
+    size_t m_count;
+    double m_mean;
+    double m_m2;                // sum of squared deviations (Welford)
+    double m_min;
+    double m_max;
+    P2Quantile m_quantiles[QuantileCount];
+};
+
+#endif
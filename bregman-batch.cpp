@@ -0,0 +1,674 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * bregman-batch -
+ * Offline batch analysis of audio files with the Dissonance plugin,
+ * writing each file's outputs as a columnar FeatureFile (.bfeat).
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "Dissonance.h"
+#include "AnalysisCache.h"
+#include "FeatureFile.h"
+#include "FrameTransform.h"
+#include "AudioFile.h"
+#include "SpectrogramFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+static void
+usage(const char *name)
+{
+    cerr << "usage: " << name << " [-s step] [-b block] [-j threads] [-d outdir] [-c cachedir] [-m model] [-g name=values]... [-r rate[:channels]] [-S rate:step] file..." << endl
+         << endl
+         << "  Analyses each audio file with the Dissonance plugin and writes" << endl
+         << "  <outdir>/<basename>.bfeat (see FeatureFile.h for the format)." << endl
+         << endl
+         << "  -s step    step size in samples (default: plugin preferred)" << endl
+         << "  -b block   block size in samples, a power of two (default: plugin preferred)" << endl
+         << "  -j threads analyse each file in this many parallel chunks" << endl
+         << "             (default: number of online processors)" << endl
+         << "  -d outdir  output directory (default: alongside each input)" << endl
+         << "  -c cachedir  reuse results and partials cached in cachedir, keyed on" << endl
+         << "             audio content, step, block, model and plugin version" << endl
+         << "  -m model   dissonance model constants, e.g. \"Dstar=0.3,s1=0.02\"" << endl
+         << "             (names: b1 b2 s1 s2 c1 c2 Dstar pruning)" << endl
+         << "  -g name=values  sweep a model constant, or numpartials, over values" << endl
+         << "             given as \"v1,v2,...\" or \"lo:hi:n\" (n evenly spaced);" << endl
+         << "             repeat for a grid over several, starting from the -m model" << endl
+         << "  -r rate[:channels]  inputs are headerless little-endian float32 at" << endl
+         << "             this sample rate (default 1 channel)" << endl
+         << "  -S rate:step  sample rate and step of .npy spectrogram inputs" << endl
+         << endl
+         << "  When only the model changes, cached runs recompute lineardissonance" << endl
+         << "  from the cached partials and skip the FFT, smoothing and peak picking." << endl
+         << endl
+         << "  With -g, each frame's partials are picked once and every configuration" << endl
+         << "  of the grid is evaluated on them.  The output file holds a single" << endl
+         << "  output, sweepdissonance, with one bin per configuration; the" << endl
+         << "  configurations are listed on standard output, the last -g varying" << endl
+         << "  fastest.  -g cannot be combined with -c." << endl
+         << endl
+         << "  Uncompressed 16, 24 and 32-bit integer and 32-bit float WAV and AIFF" << endl
+         << "  files are memory mapped and converted as each frame is windowed;" << endl
+         << "  other formats are decoded with libsndfile." << endl
+         << endl
+         << "  Inputs may also be precomputed spectrograms, as .npy arrays or raw" << endl
+         << "  BRGSPEC files (see SpectrogramFile.h), which are analysed without an" << endl
+         << "  FFT; the step and block size are those of the spectrogram." << endl;
+}
+
+static string
+outputPathFor(string input, string outdir)
+{
+    string base = input;
+    string::size_type slash = base.rfind('/');
+    string dir = ".";
+    if (slash != string::npos) {
+        dir = base.substr(0, slash);
+        base = base.substr(slash + 1);
+    }
+    string::size_type dot = base.rfind('.');
+    if (dot != string::npos && dot > 0) base = base.substr(0, dot);
+    if (outdir != "") dir = outdir;
+    return dir + "/" + base + ".bfeat";
+}
+
+static bool
+setModelConstant(DissonanceModel &model, string name, float value)
+{
+    if (name == "b1") model.b1 = value;
+    else if (name == "b2") model.b2 = value;
+    else if (name == "s1") model.s1 = value;
+    else if (name == "s2") model.s2 = value;
+    else if (name == "c1") model.c1 = value;
+    else if (name == "c2") model.c2 = value;
+    else if (name == "Dstar") model.Dstar = value;
+    else if (name == "pruning") model.pruning = value;
+    else return false;
+    return true;
+}
+
+static bool
+parseModel(string spec, DissonanceModel &model)
+{
+    while (spec != "") {
+        string::size_type comma = spec.find(',');
+        string item = spec.substr(0, comma);
+        spec = (comma == string::npos ? "" : spec.substr(comma + 1));
+        string::size_type eq = item.find('=');
+        if (eq == string::npos) return false;
+        string name = item.substr(0, eq);
+        float value = atof(item.substr(eq + 1).c_str());
+        if (!setModelConstant(model, name, value)) return false;
+    }
+    return true;
+}
+
+/* Largest numpartials a sweep may ask for, as the plugin parameter */
+#define MAX_SWEEP_PARTIALS 4096
+
+/* One dimension of a parameter sweep: a name and its values */
+struct SweepAxis
+{
+    string name;
+    vector<float> values;
+};
+
+static bool
+parseSweepAxis(string spec, SweepAxis &axis)
+{
+    string::size_type eq = spec.find('=');
+    if (eq == string::npos) return false;
+    axis.name = spec.substr(0, eq);
+    axis.values.clear();
+    DissonanceModel test;
+    if (axis.name != "numpartials" && !setModelConstant(test, axis.name, 0.0f)) {
+        return false;
+    }
+
+    spec = spec.substr(eq + 1);
+    string::size_type colon = spec.find(':');
+    if (colon != string::npos) {
+        // lo:hi:n
+        string::size_type colon2 = spec.find(':', colon + 1);
+        if (colon2 == string::npos) return false;
+        float lo = atof(spec.substr(0, colon).c_str());
+        float hi = atof(spec.substr(colon + 1, colon2 - colon - 1).c_str());
+        int n = atoi(spec.substr(colon2 + 1).c_str());
+        if (n < 1) return false;
+        for (int i = 0; i < n; ++i) {
+            axis.values.push_back(n == 1 ? lo : lo + (hi - lo) * i / (n - 1));
+        }
+    } else {
+        while (spec != "") {
+            string::size_type comma = spec.find(',');
+            axis.values.push_back(atof(spec.substr(0, comma).c_str()));
+            spec = (comma == string::npos ? "" : spec.substr(comma + 1));
+        }
+    }
+    if (axis.values.empty()) return false;
+
+    if (axis.name == "numpartials") {
+        for (size_t i = 0; i < axis.values.size(); ++i) {
+            int n = int(axis.values[i] + 0.5f);
+            if (n < 1 || n > MAX_SWEEP_PARTIALS) return false;
+            axis.values[i] = n;
+        }
+    }
+    return true;
+}
+
+/*
+ * Every combination of the axes' values, applied to model and the
+ * plugin's default partial count, the last axis varying fastest.  Each
+ * configuration is listed on standard output, by bin.
+ */
+static void
+buildSweep(const vector<SweepAxis> &axes, const DissonanceModel &model,
+           DissonanceSweep &sweep)
+{
+    size_t total = 1;
+    for (size_t a = 0; a < axes.size(); ++a) total *= axes[a].values.size();
+
+    printf("bin,b1,b2,s1,s2,c1,c2,Dstar,pruning,numpartials\n");
+    for (size_t k = 0; k < total; ++k) {
+        DissonanceModel m = model;
+        size_t numPartials = Dissonance::MaxPartials;
+        size_t rest = k;
+        for (size_t a = axes.size(); a > 0; --a) {
+            const SweepAxis &axis = axes[a - 1];
+            float value = axis.values[rest % axis.values.size()];
+            rest /= axis.values.size();
+            if (axis.name == "numpartials") numPartials = size_t(value);
+            else setModelConstant(m, axis.name, value);
+        }
+        sweep.add(m, numPartials);
+        printf("%lu,%g,%g,%g,%g,%g,%g,%g,%g,%lu\n", (unsigned long)k,
+               m.b1, m.b2, m.s1, m.s2, m.c1, m.c2, m.Dstar, m.pruning,
+               (unsigned long)numPartials);
+    }
+}
+
+/*
+ * Whether a plugin output gets a column.  Only dense outputs fit the
+ * one-row-per-frame file layout; the quality of service level is for
+ * live use and the partial tracks need tracking, which the batch path
+ * never enables, so both would only ever hold 0 or NaN.
+ */
+static bool
+isBatchOutput(const Dissonance::OutputDescriptor &d)
+{
+    return d.sampleType == Dissonance::OutputDescriptor::OneSamplePerStep &&
+        d.identifier != "qoslevel" && d.identifier != "partialtracks";
+}
+
+/*
+ * Final stage only: recompute the dissonance of every frame from a
+ * partials sidecar written by an earlier run.  The columns are those a
+ * fresh run would write, so fails if any of them is not the dissonance.
+ */
+static bool
+analysePartials(const FeatureFileReader &partials, const DissonanceModel &model,
+                const Dissonance::OutputList &outputs, FeatureFileWriter &writer)
+{
+    for (size_t o = 0; o < outputs.size(); ++o) {
+        if (isBatchOutput(outputs[o]) && outputs[o].identifier != "lineardissonance") {
+            return false;
+        }
+    }
+
+    int countOutput = partials.findOutput(PARTIALS_COUNT_OUTPUT);
+    int freqOutput = partials.findOutput(PARTIALS_FREQ_OUTPUT);
+    int magOutput = partials.findOutput(PARTIALS_MAG_OUTPUT);
+    if (countOutput < 0 || freqOutput < 0 || magOutput < 0) return false;
+
+    size_t maxPartials = partials.getOutput(freqOutput).binCount;
+    const float *counts = partials.getColumn(countOutput, 0);
+    vector<const float *> freqs, mags;
+    for (size_t b = 0; b < maxPartials; ++b) {
+        freqs.push_back(partials.getColumn(freqOutput, b));
+        mags.push_back(partials.getColumn(magOutput, b));
+    }
+
+    int output = -1;
+    for (size_t o = 0; o < outputs.size(); ++o) {
+        if (isBatchOutput(outputs[o])) {
+            output = writer.addOutput(outputs[o].identifier, outputs[o].binCount);
+        }
+    }
+    if (output < 0) return false;
+    vector<FreqSortPair> frame;
+    vector<float> values(1);
+    for (size_t f = 0; f < partials.getFrameCount(); ++f) {
+        frame.clear();
+        for (size_t b = 0; b < size_t(counts[f]) && b < maxPartials; ++b) {
+            frame.push_back(FreqSortPair(freqs[b][f], mags[b][f]));
+        }
+        values[0] = Dissonance::dissonance(frame, model);
+        if (isnan(values[0]) || isinf(values[0])) continue;
+        writer.setValues(output, f, values);
+    }
+    writer.setFrameCount(partials.getFrameCount());
+    return true;
+}
+
+/*
+ * Frames are independent (the smoothing filter is reset per frame and
+ * the batch path never enables partial tracking), so a long file is cut
+ * into contiguous frame ranges that are analysed on separate threads,
+ * each with its own sound file handle, plugin instance and workspace.
+ * Frame k always covers samples [k * step, k * step + block), so a chunk
+ * only needs to seek to its first frame and prime one block of input;
+ * the stitched result is identical to a serial run.
+ */
+
+#define MIN_CHUNK_FRAMES 2048
+
+/*
+ * How to interpret input files that do not describe themselves
+ */
+struct InputFormat
+{
+    InputFormat() : rawSampleRate(0), rawChannels(1), spectrogramRate(0), spectrogramStep(0) { }
+
+    int rawSampleRate;                  /* non-zero for headerless audio */
+    int rawChannels;
+    float spectrogramRate;              /* for .npy spectrograms */
+    size_t spectrogramStep;
+};
+
+struct ChunkJob
+{
+    string path;
+    const InputFormat *format;
+    bool spectrogram;                   /* path is a SpectrogramFile */
+    float sampleRate;
+    size_t stepSize;
+    size_t blockSize;
+    const DissonanceModel *model;
+    size_t startFrame;
+    size_t endFrame;
+    FeatureFileWriter *writer;
+    const vector<int> *columns;         /* writer output per plugin output */
+    FeatureFileWriter *partialsWriter;  /* 0 unless caching */
+    int countOutput, freqOutput, magOutput;
+    const DissonanceSweep *sweep;       /* 0 unless sweeping */
+    int sweepOutput;
+    size_t denormalFrames;
+    bool ok;
+};
+
+static void *
+analyseChunk(void *arg)
+{
+    ChunkJob &job = *(ChunkJob *)arg;
+    const size_t stepSize = job.stepSize, blockSize = job.blockSize;
+
+    const InputFormat &format = *job.format;
+    AudioFile audio;
+    SpectrogramFile spectrogram;
+    if (job.spectrogram) {
+        if (!spectrogram.open(job.path, format.spectrogramRate, format.spectrogramStep)) return 0;
+    } else if (!audio.open(job.path, format.rawSampleRate, format.rawChannels)) {
+        return 0;
+    }
+
+    Dissonance plugin(job.sampleRate);
+    plugin.setModel(*job.model);
+    if (job.sweep) plugin.setParameter("numpartials", job.sweep->getMaxPartials());
+    if (!plugin.initialise(1, stepSize, blockSize)) return 0;
+
+    FeatureFileWriter &writer = *job.writer;
+    FeatureFileWriter *partialsWriter = job.partialsWriter;
+    vector<float> count(1), freqs, mags;
+
+    // a sweep keeps scratch space, so each chunk has its own
+    DissonanceSweep sweep;
+    vector<float> sweepValues;
+    if (job.sweep) {
+        sweep = *job.sweep;
+        sweepValues.resize(sweep.getCount());
+    }
+
+    // Spectra are handed to the plugin in batches, so that it can smooth
+    // several frames at once
+    const size_t batch = 32;
+    vector<vector<float> > spectra(batch, vector<float>(blockSize + 2));
+    vector<const float *> batchPtrs(batch);
+    vector<Dissonance::FeatureSet> batchFeatures;
+    vector<vector<FreqSortPair> > batchPartials;
+    size_t pending = 0;
+
+    FrameTransform transform(blockSize);
+
+    for (size_t frame = job.startFrame; frame < job.endFrame; ++frame) {
+        if (job.spectrogram) {
+            // precomputed spectra skip the transform, complex ones the copy too
+            batchPtrs[pending] = spectrogram.getFrame(frame, &spectra[pending][0]);
+        } else {
+            // frame windows come straight from the file mapping where possible
+            const float *spectrum = transform.process(audio.window(frame * stepSize, blockSize));
+            std::copy(spectrum, spectrum + blockSize + 2, spectra[pending].begin());
+            batchPtrs[pending] = &spectra[pending][0];
+        }
+        if (++pending < batch && frame + 1 < job.endFrame) continue;
+
+        plugin.processFrames(&batchPtrs[0], pending, batchFeatures,
+                             (partialsWriter || job.sweep) ? &batchPartials : 0);
+        size_t first = frame + 1 - pending;
+        for (size_t b = 0; b < pending; ++b) {
+            const Dissonance::FeatureSet &fs = batchFeatures[b];
+            for (Dissonance::FeatureSet::const_iterator i = fs.begin(); i != fs.end(); ++i) {
+                if (i->second.empty() || (*job.columns)[i->first] < 0) continue;
+                writer.setValues((*job.columns)[i->first], first + b, i->second[0].values);
+            }
+
+            if (job.sweep) {
+                const vector<FreqSortPair> &partials = batchPartials[b];
+                sweep.evaluate(partials.empty() ? 0 : &partials[0], partials.size(),
+                               &sweepValues[0]);
+                // as the plugin drops non-finite values, leave them missing
+                for (size_t v = 0; v < sweepValues.size(); ++v) {
+                    if (isinf(sweepValues[v])) {
+                        sweepValues[v] = std::numeric_limits<float>::quiet_NaN();
+                    }
+                }
+                writer.setValues(job.sweepOutput, first + b, sweepValues);
+            }
+
+            if (partialsWriter) {
+                const vector<FreqSortPair> &partials = batchPartials[b];
+                count[0] = partials.size();
+                freqs.assign(Dissonance::MaxPartials, 0.0f);
+                mags.assign(Dissonance::MaxPartials, 0.0f);
+                for (size_t p = 0; p < partials.size(); ++p) {
+                    freqs[p] = partials[p].first;
+                    mags[p] = partials[p].second;
+                }
+                partialsWriter->setValues(job.countOutput, first + b, count);
+                partialsWriter->setValues(job.freqOutput, first + b, freqs);
+                partialsWriter->setValues(job.magOutput, first + b, mags);
+            }
+        }
+        pending = 0;
+    }
+
+    job.denormalFrames = plugin.getDenormalFrameCount();
+    job.ok = true;
+    return 0;
+}
+
+static bool
+analyseFile(string path, string outPath, size_t stepSize, size_t blockSize,
+            const DissonanceModel &model, const AnalysisCache *cache,
+            const DissonanceSweep *sweep, size_t threads,
+            const InputFormat &format)
+{
+    AnalysisKey key;
+    if (cache) {
+        if (!AnalysisCache::hashFile(path, key.audioHash)) return false;
+        key.model = model;
+    }
+
+    // A spectrogram fixes the step and block size and its frame count
+    const bool spectral = SpectrogramFile::recognise(path);
+    float sampleRate;
+    size_t frames, frameCount = 0;
+    if (spectral) {
+        SpectrogramFile spectrogram;
+        if (!spectrogram.open(path, format.spectrogramRate, format.spectrogramStep)) {
+            cerr << "ERROR: bregman-batch: " << spectrogram.getError() << endl;
+            return false;
+        }
+        if ((stepSize && stepSize != spectrogram.getStepSize()) ||
+            (blockSize && blockSize != spectrogram.getBlockSize())) {
+            cerr << "ERROR: bregman-batch: step or block size given does not match spectrogram \""
+                 << path << "\"" << endl;
+            return false;
+        }
+        sampleRate = spectrogram.getSampleRate();
+        stepSize = spectrogram.getStepSize();
+        blockSize = spectrogram.getBlockSize();
+        frameCount = spectrogram.getFrameCount();
+        frames = frameCount * stepSize;
+        // .npy files take their rate and step from -S, so key on the
+        // effective values (the step is keyed below, once it is final)
+        key.sampleRate = sampleRate;
+        key.channels = 1;
+    } else {
+        AudioFile audio;
+        if (!audio.open(path, format.rawSampleRate, format.rawChannels)) {
+            cerr << "ERROR: bregman-batch: " << audio.getError() << endl;
+            return false;
+        }
+        sampleRate = audio.getSampleRate();
+        frames = audio.getFrameCount();
+        key.sampleRate = sampleRate;
+        key.channels = audio.getChannels();
+    }
+
+    Dissonance plugin(sampleRate);
+    plugin.setModel(model);
+    if (stepSize == 0) stepSize = plugin.getPreferredStepSize();
+    if (blockSize == 0) blockSize = plugin.getPreferredBlockSize();
+    if (!spectral) frameCount = (frames + stepSize - 1) / stepSize;
+    if (stepSize > blockSize || !plugin.initialise(1, stepSize, blockSize)) {
+        cerr << "ERROR: bregman-batch: failed to initialise plugin for \""
+             << path << "\"" << endl;
+        return false;
+    }
+
+    FeatureFileWriter writer(sampleRate, stepSize, blockSize,
+                             plugin.getIdentifier(), plugin.getPluginVersion());
+
+    Dissonance::OutputList outputs = plugin.getOutputDescriptors();
+
+    if (cache) {
+        key.stepSize = stepSize;
+        key.blockSize = blockSize;
+        key.pluginVersion = plugin.getPluginVersion();
+
+        // First level: the complete result for this audio and model
+        if (AnalysisCache::fetch(cache->getResultPath(key), outPath)) {
+            cerr << path << ": cached result" << endl;
+            return true;
+        }
+
+        // Second level: partials from a run with a different model
+        FeatureFileReader partials;
+        if (partials.open(cache->getPartialsPath(key)) &&
+            analysePartials(partials, model, outputs, writer)) {
+            cerr << path << ": recomputed from cached partials" << endl;
+            AnalysisCache::store(writer, cache->getResultPath(key));
+            return writer.write(outPath);
+        }
+    }
+
+    vector<int> columns(outputs.size());
+    for (size_t o = 0; o < outputs.size(); ++o) {
+        columns[o] = -1;
+        if (sweep || !isBatchOutput(outputs[o])) continue;
+        columns[o] = writer.addOutput(outputs[o].identifier, outputs[o].binCount);
+    }
+    int sweepOutput = (sweep ? writer.addOutput("sweepdissonance", sweep->getCount()) : -1);
+
+    FeatureFileWriter partialsWriter(sampleRate, stepSize, blockSize,
+                                     plugin.getIdentifier(), plugin.getPluginVersion());
+    int countOutput = partialsWriter.addOutput(PARTIALS_COUNT_OUTPUT, 1);
+    int freqOutput = partialsWriter.addOutput(PARTIALS_FREQ_OUTPUT, Dissonance::MaxPartials);
+    int magOutput = partialsWriter.addOutput(PARTIALS_MAG_OUTPUT, Dissonance::MaxPartials);
+
+    // Size every column up front: the chunks then write disjoint frame
+    // ranges of preallocated storage and need no locking.
+    writer.setFrameCount(frameCount);
+    if (cache) partialsWriter.setFrameCount(frameCount);
+
+    size_t chunks = std::max(size_t(1), std::min(threads, frameCount / MIN_CHUNK_FRAMES));
+    vector<ChunkJob> jobs(chunks);
+    for (size_t k = 0; k < chunks; ++k) {
+        ChunkJob &job = jobs[k];
+        job.path = path;
+        job.format = &format;
+        job.spectrogram = spectral;
+        job.sampleRate = sampleRate;
+        job.stepSize = stepSize;
+        job.blockSize = blockSize;
+        job.model = &model;
+        job.startFrame = frameCount * k / chunks;
+        job.endFrame = frameCount * (k + 1) / chunks;
+        job.writer = &writer;
+        job.columns = &columns;
+        job.partialsWriter = (cache ? &partialsWriter : 0);
+        job.countOutput = countOutput;
+        job.freqOutput = freqOutput;
+        job.magOutput = magOutput;
+        job.sweep = sweep;
+        job.sweepOutput = sweepOutput;
+        job.denormalFrames = 0;
+        job.ok = false;
+    }
+
+    if (chunks == 1) {
+        analyseChunk(&jobs[0]);
+    } else {
+        vector<pthread_t> tids(chunks);
+        vector<bool> started(chunks, false);
+        for (size_t k = 0; k < chunks; ++k) {
+            started[k] = (pthread_create(&tids[k], 0, analyseChunk, &jobs[k]) == 0);
+            if (!started[k]) analyseChunk(&jobs[k]);
+        }
+        for (size_t k = 0; k < chunks; ++k) {
+            if (started[k]) pthread_join(tids[k], 0);
+        }
+    }
+
+    size_t denormalFrames = 0;
+    for (size_t k = 0; k < chunks; ++k) {
+        denormalFrames += jobs[k].denormalFrames;
+        if (!jobs[k].ok) {
+            cerr << "ERROR: bregman-batch: analysis of \"" << path
+                 << "\" failed in frames " << jobs[k].startFrame << " to "
+                 << jobs[k].endFrame << endl;
+            return false;
+        }
+    }
+    if (denormalFrames) {
+        cerr << path << ": flushed subnormals while smoothing "
+             << denormalFrames << " of " << frameCount << " frames" << endl;
+    }
+
+    if (cache) {
+        AnalysisCache::store(partialsWriter, cache->getPartialsPath(key));
+        AnalysisCache::store(writer, cache->getResultPath(key));
+    }
+
+    return writer.write(outPath);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *name = argv[0];
+    size_t stepSize = 0, blockSize = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    string outdir, cachedir;
+    DissonanceModel model;
+    vector<SweepAxis> axes;
+    InputFormat format;
+
+    int c;
+    while ((c = getopt(argc, argv, "s:b:j:d:c:m:g:r:S:h")) != -1) {
+        switch (c) {
+        case 's': stepSize = atoi(optarg); break;
+        case 'b': blockSize = atoi(optarg); break;
+        case 'j': threads = atoi(optarg); break;
+        case 'd': outdir = optarg; break;
+        case 'c': cachedir = optarg; break;
+        case 'm':
+            if (!parseModel(optarg, model)) {
+                cerr << "ERROR: bregman-batch: bad model \"" << optarg << "\"" << endl;
+                return 2;
+            }
+            break;
+        case 'g':
+            axes.push_back(SweepAxis());
+            if (!parseSweepAxis(optarg, axes.back())) {
+                cerr << "ERROR: bregman-batch: bad sweep \"" << optarg << "\"" << endl;
+                return 2;
+            }
+            break;
+        case 'r':
+            if (sscanf(optarg, "%d:%d", &format.rawSampleRate, &format.rawChannels) < 1 ||
+                format.rawSampleRate <= 0 || format.rawChannels <= 0) {
+                cerr << "ERROR: bregman-batch: bad raw format \"" << optarg << "\"" << endl;
+                return 2;
+            }
+            break;
+        case 'S': {
+            unsigned long step = 0;
+            if (sscanf(optarg, "%f:%lu", &format.spectrogramRate, &step) != 2 ||
+                format.spectrogramRate <= 0 || step == 0) {
+                cerr << "ERROR: bregman-batch: bad spectrogram format \"" << optarg << "\"" << endl;
+                return 2;
+            }
+            format.spectrogramStep = step;
+            break;
+        }
+        default: usage(name); return 2;
+        }
+    }
+    if (optind >= argc) {
+        usage(name);
+        return 2;
+    }
+    if (blockSize && (blockSize & (blockSize - 1))) {
+        cerr << "ERROR: bregman-batch: block size must be a power of two" << endl;
+        return 2;
+    }
+
+    if (!axes.empty() && cachedir != "") {
+        cerr << "ERROR: bregman-batch: -g cannot be combined with -c" << endl;
+        return 2;
+    }
+
+    if (threads < 1) threads = 1;
+
+    DissonanceSweep sweep;
+    if (!axes.empty()) buildSweep(axes, model, sweep);
+
+    AnalysisCache cache(cachedir);
+
+    int failures = 0;
+    for (int i = optind; i < argc; ++i) {
+        string out = outputPathFor(argv[i], outdir);
+        if (analyseFile(argv[i], out, stepSize, blockSize, model,
+                        cachedir != "" ? &cache : 0,
+                        axes.empty() ? 0 : &sweep, threads,
+                        format)) {
+            cerr << argv[i] << " -> " << out << endl;
+        } else {
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
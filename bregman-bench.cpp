@@ -0,0 +1,364 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * bregman-bench -
+ * End-to-end throughput benchmark of the Dissonance plugin on a
+ * reproducible synthetic corpus, reporting real-time factors as JSON.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "Dissonance.h"
+#include "FrameTransform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+/* Default configurations: step:block pairs, and worker thread counts */
+#define DEFAULT_CONFIGS "512:2048,2048:8192,4096:32768"
+#define DEFAULT_THREADS "0,2,4"
+
+/* Default length of each corpus section in seconds */
+#define DEFAULT_SECTION_SECONDS 6.0
+
+/* Seconds over which the faded section rises and falls */
+#define FADE_SECONDS 2.0
+
+static void
+usage(const char *name)
+{
+    cerr << "usage: " << name << " [-r rate] [-t seconds] [-c configs] [-j threads] [-o out.json]" << endl
+         << endl
+         << "  Generates a synthetic corpus in memory and times the full Dissonance" << endl
+         << "  pipeline over it (windowing, FFT and process()) at each configuration" << endl
+         << "  and thread count, writing the results as JSON." << endl
+         << endl
+         << "  -r rate     sample rate of the corpus (default 44100)" << endl
+         << "  -t seconds  length of each of the five corpus sections (default " << DEFAULT_SECTION_SECONDS << ")" << endl
+         << "  -c configs  step:block pairs (default " << DEFAULT_CONFIGS << ")" << endl
+         << "  -j threads  values of the plugin's threads parameter, 0 analysing" << endl
+         << "              in process() (default " << DEFAULT_THREADS << ")" << endl
+         << "  -o file     write the JSON here rather than to standard output" << endl;
+}
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Peak resident set size of this process over its lifetime, in kilobytes */
+static long
+peakRss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/*
+ * The corpus: five sections of equal length, each exercising a
+ * different regime of the analysis.  Everything is computed from the
+ * sample index (noise from a fixed linear congruential sequence), so
+ * the corpus is identical on every run and platform.
+ */
+
+static const char *const sectionNames[] = {
+    "chord", "harmonic", "noise", "silence", "fade"
+};
+static const size_t sectionCount = 5;
+
+static void
+addSine(float *out, size_t n, float rate, double freq, double amp)
+{
+    double w = 2.0 * M_PI * freq / rate;
+    for (size_t i = 0; i < n; ++i) out[i] += amp * sin(w * i);
+}
+
+static void
+generateCorpus(float rate, size_t sectionLength, vector<float> &corpus)
+{
+    corpus.assign(sectionLength * sectionCount, 0.0f);
+
+    // major triad and a seventh over A3, in just intervals (4:5:6:7)
+    float *chord = &corpus[0];
+    const double ratios[] = { 1.0, 5.0/4.0, 3.0/2.0, 7.0/4.0 };
+    for (size_t k = 0; k < 4; ++k) {
+        addSine(chord, sectionLength, rate, 220.0 * ratios[k], 0.2);
+    }
+
+    // harmonic tone on 110 Hz with 1/k partials up to Nyquist
+    float *harmonic = &corpus[sectionLength];
+    for (size_t k = 1; 110.0 * k < rate / 2; ++k) {
+        addSine(harmonic, sectionLength, rate, 110.0 * k, 0.3 / k);
+    }
+
+    // uniform white noise
+    float *noise = &corpus[2 * sectionLength];
+    unsigned long state = 1;
+    for (size_t i = 0; i < sectionLength; ++i) {
+        state = (state * 1103515245ul + 12345ul) & 0x7ffffffful;
+        noise[i] = 0.5f * (float(state) / 0x3fffffff - 1.0f);
+    }
+
+    // (section 3 is silence)
+
+    // a minor second dyad fading in and out
+    float *fade = &corpus[4 * sectionLength];
+    addSine(fade, sectionLength, rate, 440.0, 0.4);
+    addSine(fade, sectionLength, rate, 440.0 * pow(2.0, 1.0 / 12), 0.4);
+    size_t ramp = std::min(sectionLength / 2, size_t(FADE_SECONDS * rate));
+    for (size_t i = 0; i < ramp; ++i) {
+        float g = float(i) / ramp;
+        fade[i] *= g;
+        fade[sectionLength - 1 - i] *= g;
+    }
+}
+
+struct BenchResult
+{
+    size_t stepSize;
+    size_t blockSize;
+    size_t threads;
+    size_t frames;
+    double seconds;
+    double p50, p90, p99, max;  // per-frame latency, seconds
+};
+
+static double
+percentile(const vector<double> &sorted, double p)
+{
+    if (sorted.empty()) return 0.0;
+    size_t i = size_t(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+/*
+ * Run the corpus through a fresh plugin, as a host would: a block
+ * advancing by one step per frame, transformed and passed to process().
+ * A frame's latency runs from the start of its transform to the return
+ * of the call that delivered its lineardissonance value, which with
+ * worker threads is a later process() or getRemainingFeatures().
+ */
+static bool
+runBench(const vector<float> &corpus, float rate, size_t stepSize,
+         size_t blockSize, size_t threads, BenchResult &result)
+{
+    Dissonance plugin(rate);
+    plugin.setParameter("threads", threads);
+    if (!plugin.initialise(1, stepSize, blockSize)) {
+        cerr << "ERROR: bregman-bench: failed to initialise plugin with step "
+             << stepSize << ", block " << blockSize << endl;
+        return false;
+    }
+
+    unsigned int irate = (unsigned int)(rate + 0.5f);
+    size_t frames = (corpus.size() + stepSize - 1) / stepSize;
+    FrameTransform transform(blockSize);
+    vector<float> block(blockSize, 0.0f);
+    vector<double> started(frames, 0.0), latency(frames, 0.0);
+
+    double start = now();
+    for (size_t f = 0; f < frames; ++f) {
+        // shift one step and append the next step of input
+        memmove(&block[0], &block[stepSize], (blockSize - stepSize) * sizeof(float));
+        for (size_t i = 0; i < stepSize; ++i) {
+            size_t s = f * stepSize + i;
+            block[blockSize - stepSize + i] = (s < corpus.size() ? corpus[s] : 0.0f);
+        }
+
+        started[f] = now();
+        const float *spectrum = transform.process(&block[0]);
+        Vamp::RealTime timestamp = Vamp::RealTime::frame2RealTime(f * stepSize, irate);
+        Dissonance::FeatureSet features = plugin.process(&spectrum, timestamp);
+        double done = now();
+
+        const Dissonance::FeatureList &list = features[0];
+        for (size_t k = 0; k < list.size(); ++k) {
+            size_t frame = f;
+            if (list[k].hasTimestamp) {
+                frame = Vamp::RealTime::realTime2Frame(list[k].timestamp, irate) / stepSize;
+            }
+            if (frame < frames) latency[frame] = done - started[frame];
+        }
+    }
+    Dissonance::FeatureSet features = plugin.getRemainingFeatures();
+    double done = now();
+    const Dissonance::FeatureList &list = features[0];
+    for (size_t k = 0; k < list.size(); ++k) {
+        if (!list[k].hasTimestamp) continue;
+        size_t frame = Vamp::RealTime::realTime2Frame(list[k].timestamp, irate) / stepSize;
+        if (frame < frames) latency[frame] = done - started[frame];
+    }
+
+    result.stepSize = stepSize;
+    result.blockSize = blockSize;
+    result.threads = threads;
+    result.frames = frames;
+    result.seconds = done - start;
+    std::sort(latency.begin(), latency.end());
+    result.p50 = percentile(latency, 0.5);
+    result.p90 = percentile(latency, 0.9);
+    result.p99 = percentile(latency, 0.99);
+    result.max = (latency.empty() ? 0.0 : latency.back());
+    return true;
+}
+
+static bool
+parseSizes(string spec, vector<size_t> &values)
+{
+    values.clear();
+    while (spec != "") {
+        string::size_type comma = spec.find(',');
+        string item = spec.substr(0, comma);
+        spec = (comma == string::npos ? "" : spec.substr(comma + 1));
+        char *end = 0;
+        long v = strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() || *end || v < 0) return false;
+        values.push_back(v);
+    }
+    return !values.empty();
+}
+
+static bool
+parseConfigs(string spec, vector<size_t> &steps, vector<size_t> &blocks)
+{
+    steps.clear();
+    blocks.clear();
+    while (spec != "") {
+        string::size_type comma = spec.find(',');
+        string item = spec.substr(0, comma);
+        spec = (comma == string::npos ? "" : spec.substr(comma + 1));
+        int step = 0, block = 0;
+        if (sscanf(item.c_str(), "%d:%d", &step, &block) != 2) return false;
+        if (step < 1 || block < 2 || step > block || (block & (block - 1))) return false;
+        steps.push_back(step);
+        blocks.push_back(block);
+    }
+    return !steps.empty();
+}
+
+static void
+writeJson(FILE *out, float rate, double corpusSeconds, const vector<BenchResult> &results)
+{
+    Dissonance plugin(rate);
+    fprintf(out, "{\n");
+    fprintf(out, "  \"plugin\": \"%s\",\n", plugin.getIdentifier().c_str());
+    fprintf(out, "  \"plugin_version\": %d,\n", plugin.getPluginVersion());
+    fprintf(out, "  \"sample_rate\": %g,\n", rate);
+    fprintf(out, "  \"corpus_seconds\": %g,\n", corpusSeconds);
+    // the process-wide high-water mark, over the corpus and every run
+    fprintf(out, "  \"peak_rss_kb\": %ld,\n", peakRss());
+    fprintf(out, "  \"corpus_sections\": [");
+    for (size_t s = 0; s < sectionCount; ++s) {
+        fprintf(out, "%s\"%s\"", s ? ", " : "", sectionNames[s]);
+    }
+    fprintf(out, "],\n");
+    fprintf(out, "  \"runs\": [\n");
+    for (size_t r = 0; r < results.size(); ++r) {
+        const BenchResult &b = results[r];
+        fprintf(out, "    {\"step\": %lu, \"block\": %lu, \"threads\": %lu, "
+                "\"frames\": %lu, \"seconds\": %.6f, \"realtime_factor\": %.3f, "
+                "\"frames_per_second\": %.1f, \"latency_ms\": {\"p50\": %.4f, "
+                "\"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}}%s\n",
+                (unsigned long)b.stepSize, (unsigned long)b.blockSize,
+                (unsigned long)b.threads, (unsigned long)b.frames, b.seconds,
+                b.seconds > 0.0 ? corpusSeconds / b.seconds : 0.0,
+                b.seconds > 0.0 ? b.frames / b.seconds : 0.0,
+                b.p50 * 1000.0, b.p90 * 1000.0, b.p99 * 1000.0, b.max * 1000.0,
+                r + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *name = argv[0];
+    float rate = 44100.0f;
+    double sectionSeconds = DEFAULT_SECTION_SECONDS;
+    vector<size_t> steps, blocks, threads;
+    string outPath;
+    parseConfigs(DEFAULT_CONFIGS, steps, blocks);
+    parseSizes(DEFAULT_THREADS, threads);
+
+    int c;
+    while ((c = getopt(argc, argv, "r:t:c:j:o:h")) != -1) {
+        switch (c) {
+        case 'r': rate = atof(optarg); break;
+        case 't': sectionSeconds = atof(optarg); break;
+        case 'c':
+            if (!parseConfigs(optarg, steps, blocks)) {
+                cerr << "ERROR: bregman-bench: bad configurations \"" << optarg
+                     << "\" (want step:block,... with power-of-two blocks)" << endl;
+                return 2;
+            }
+            break;
+        case 'j':
+            if (!parseSizes(optarg, threads)) {
+                cerr << "ERROR: bregman-bench: bad thread counts \"" << optarg << "\"" << endl;
+                return 2;
+            }
+            break;
+        case 'o': outPath = optarg; break;
+        default: usage(name); return 2;
+        }
+    }
+    if (optind < argc || !(rate > 0.0f) || !(sectionSeconds > 0.0)) {
+        usage(name);
+        return 2;
+    }
+
+    size_t sectionLength = size_t(sectionSeconds * rate);
+    vector<float> corpus;
+    generateCorpus(rate, sectionLength, corpus);
+    double corpusSeconds = corpus.size() / double(rate);
+
+    vector<BenchResult> results;
+    for (size_t k = 0; k < steps.size(); ++k) {
+        for (size_t t = 0; t < threads.size(); ++t) {
+            BenchResult result;
+            if (!runBench(corpus, rate, steps[k], blocks[k], threads[t], result)) return 1;
+            cerr << "step " << steps[k] << ", block " << blocks[k] << ", threads "
+                 << threads[t] << ": " << corpusSeconds / result.seconds
+                 << "x real time" << endl;
+            results.push_back(result);
+        }
+    }
+
+    FILE *out = stdout;
+    if (outPath != "") {
+        out = fopen(outPath.c_str(), "w");
+        if (!out) {
+            cerr << "ERROR: bregman-bench: failed to open \"" << outPath
+                 << "\" for writing" << endl;
+            return 1;
+        }
+    }
+    writeJson(out, rate, corpusSeconds, results);
+    if (out != stdout) fclose(out);
+    return 0;
+}
@@ -0,0 +1,236 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * bregman-client -
+ * Streams an audio file to bregman-daemon and prints the dissonance
+ * values it sends back, with their latency and the daemon's backlog.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "StreamProtocol.h"
+
+#include <sndfile.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+#define SEND_FRAMES 1024
+
+static void
+usage(const char *name)
+{
+    cerr << "usage: " << name << " [-S socket] [-s step] [-b block] [-r] [-o output.csv] audiofile" << endl
+         << endl
+         << "  Sends audiofile to a running bregman-daemon and writes one CSV line" << endl
+         << "  per frame: time, dissonance, latency (ms), daemon backlog (samples)." << endl
+         << "  A latency and backlog summary is printed on standard error." << endl
+         << endl
+         << "  -S socket  daemon socket (default: " << STREAM_DEFAULT_SOCKET << ")" << endl
+         << "  -s step    step size in samples (default: plugin preferred)" << endl
+         << "  -b block   block size in samples, a power of two (default: plugin preferred)" << endl
+         << "  -r         send in real time, as a live source would" << endl
+         << "  -o file    write CSV to file (default: standard output)" << endl;
+}
+
+struct Receiver
+{
+    int fd;
+    FILE *out;
+    uint64_t frames;
+    double latencySum;
+    double latencyMax;
+    uint32_t backlogMax;
+};
+
+static bool
+recvAll(int fd, void *data, size_t n)
+{
+    char *p = (char *)data;
+    while (n > 0) {
+        ssize_t got = recv(fd, p, n, 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        n -= got;
+    }
+    return true;
+}
+
+static bool
+sendAll(int fd, const void *data, size_t n)
+{
+    const char *p = (const char *)data;
+    while (n > 0) {
+        ssize_t sent = send(fd, p, n, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+static void *
+receive(void *arg)
+{
+    Receiver &r = *(Receiver *)arg;
+    StreamResult result;
+    while (recvAll(r.fd, &result, sizeof(result))) {
+        if (isnan(result.dissonance)) {
+            fprintf(r.out, "%.6f,,%.3f,%u\n", result.time, result.latency, result.backlog);
+        } else {
+            fprintf(r.out, "%.6f,%.9g,%.3f,%u\n", result.time, result.dissonance,
+                    result.latency, result.backlog);
+        }
+        ++r.frames;
+        r.latencySum += result.latency;
+        r.latencyMax = std::max(r.latencyMax, double(result.latency));
+        r.backlogMax = std::max(r.backlogMax, result.backlog);
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *name = argv[0];
+    string path = STREAM_DEFAULT_SOCKET, outfile;
+    size_t stepSize = 0, blockSize = 0;
+    bool realtime = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "S:s:b:ro:h")) != -1) {
+        switch (c) {
+        case 'S': path = optarg; break;
+        case 's': stepSize = atoi(optarg); break;
+        case 'b': blockSize = atoi(optarg); break;
+        case 'r': realtime = true; break;
+        case 'o': outfile = optarg; break;
+        default: usage(name); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(name);
+        return 2;
+    }
+    const char *input = argv[optind];
+
+    SF_INFO info;
+    memset(&info, 0, sizeof(info));
+    SNDFILE *sndfile = sf_open(input, SFM_READ, &info);
+    if (!sndfile) {
+        cerr << "ERROR: bregman-client: failed to open \"" << input << "\": "
+             << sf_strerror(0) << endl;
+        return 1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        cerr << "ERROR: bregman-client: cannot connect to \"" << path << "\": "
+             << strerror(errno) << endl;
+        sf_close(sndfile);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    StreamRequest request;
+    request.magic = STREAM_MAGIC;
+    request.version = STREAM_VERSION;
+    request.sampleRate = info.samplerate;
+    request.channels = info.channels;
+    request.stepSize = stepSize;
+    request.blockSize = blockSize;
+    StreamReply reply;
+    if (!sendAll(fd, &request, sizeof(request)) ||
+        !recvAll(fd, &reply, sizeof(reply)) ||
+        reply.magic != STREAM_MAGIC || reply.status != 0) {
+        cerr << "ERROR: bregman-client: daemon refused the stream" << endl;
+        sf_close(sndfile);
+        close(fd);
+        return 1;
+    }
+
+    Receiver r;
+    r.fd = fd;
+    r.out = stdout;
+    r.frames = 0;
+    r.latencySum = 0.0;
+    r.latencyMax = 0.0;
+    r.backlogMax = 0;
+    if (outfile != "" && !(r.out = fopen(outfile.c_str(), "w"))) {
+        perror(outfile.c_str());
+        sf_close(sndfile);
+        close(fd);
+        return 1;
+    }
+    fprintf(r.out, "time,dissonance,latency_ms,backlog\n");
+
+    pthread_t receiver;
+    if (pthread_create(&receiver, 0, receive, &r) != 0) {
+        cerr << "ERROR: bregman-client: cannot start receiver thread" << endl;
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    vector<float> buffer(SEND_FRAMES * info.channels);
+    sf_count_t sent = 0;
+    bool ok = true;
+    while (ok) {
+        sf_count_t got = sf_readf_float(sndfile, &buffer[0], SEND_FRAMES);
+        if (got <= 0) break;
+        if (realtime) {
+            // wait until the last of these samples would have been captured
+            double due = double(sent + got) / info.samplerate;
+            struct timespec t;
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            double wait = due - ((t.tv_sec - start.tv_sec) + (t.tv_nsec - start.tv_nsec) * 1e-9);
+            if (wait > 0) {
+                t.tv_sec = time_t(wait);
+                t.tv_nsec = long((wait - t.tv_sec) * 1e9);
+                nanosleep(&t, 0);
+            }
+        }
+        ok = sendAll(fd, &buffer[0], got * info.channels * sizeof(float));
+        sent += got;
+    }
+    shutdown(fd, SHUT_WR);
+    sf_close(sndfile);
+
+    pthread_join(receiver, 0);
+    close(fd);
+    if (r.out != stdout) fclose(r.out);
+
+    cerr << input << ": " << r.frames << " frames (step " << reply.stepSize
+         << ", block " << reply.blockSize << "), latency mean "
+         << (r.frames ? r.latencySum / r.frames : 0.0) << " ms, max "
+         << r.latencyMax << " ms, backlog max " << r.backlogMax << " samples" << endl;
+
+    return ok ? 0 : 1;
+}
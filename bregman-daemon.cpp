@@ -0,0 +1,535 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * bregman-daemon -
+ * Streaming dissonance analysis served over a Unix domain socket.
+ * See StreamProtocol.h for the wire format and bregman-client for a
+ * client.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "Dissonance.h"
+#include "FrameTransform.h"
+#include "SPSCRing.h"
+#include "StreamProtocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+/*
+ * One thread does all socket input: it accepts connections, reads PCM
+ * from every client and appends it to that stream's audio ring.  Each
+ * stream has its own analysis worker, the ring's only consumer, which
+ * mixes down, analyses and sends results back on the same socket.
+ * When a worker falls behind, its ring fills and the input thread
+ * stops reading from that client, so the backlog stays bounded and the
+ * client is slowed by the socket rather than the daemon growing.
+ * A new connection's request is read as it arrives, in the same poll
+ * loop, so a client that stalls mid-request holds up no other stream.
+ */
+
+#define AUDIO_RING_SECONDS 2
+#define ARRIVAL_RING_SIZE 1024
+#define READ_BUFFER_BYTES 65536
+#define POLL_INTERVAL_MS 20
+#define HANDSHAKE_TIMEOUT_S 2
+
+static double
+now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Sample count received by a given time, for latency measurement. */
+struct Arrival
+{
+    uint64_t end;
+    double when;
+};
+
+struct Stream
+{
+    Stream(int fd_, const StreamRequest &request_, size_t step, size_t block,
+           Dissonance *plugin_, size_t id_) :
+        id(id_),
+        fd(fd_),
+        request(request_),
+        stepSize(step),
+        blockSize(block),
+        plugin(plugin_),
+        audio(std::max(size_t(request_.sampleRate * AUDIO_RING_SECONDS),
+                       block * 4) * request_.channels),
+        arrivals(ARRIVAL_RING_SIZE),
+        partialBytes(0),
+        floats(0),
+        received(0),
+        eof(0),
+        done(0),
+        frames(0),
+        latencySum(0.0),
+        latencyMax(0.0),
+        backlogMax(0)
+    {
+        pthread_mutex_init(&mutex, 0);
+        pthread_cond_init(&cond, 0);
+    }
+
+    ~Stream() {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+        delete plugin;
+    }
+
+    size_t id;
+    int fd;
+    StreamRequest request;
+    size_t stepSize;
+    size_t blockSize;
+    Dissonance *plugin;
+
+    SPSCRing<float> audio;      // interleaved PCM
+    SPSCRing<Arrival> arrivals;
+
+    // input thread only
+    char partial[sizeof(float)];
+    size_t partialBytes;
+    uint64_t floats;
+
+    // written by the input thread, read by the worker
+    uint64_t received;          // complete sample frames in audio so far
+    int eof;
+    pthread_mutex_t mutex;      // only for sleeping on an empty ring
+    pthread_cond_t cond;
+
+    // written by the worker, read by the input thread once done is set
+    int done;
+    pthread_t worker;
+    uint64_t frames;
+    double latencySum;
+    double latencyMax;
+    size_t backlogMax;
+};
+
+static void
+wake(Stream &s)
+{
+    pthread_mutex_lock(&s.mutex);
+    pthread_cond_signal(&s.cond);
+    pthread_mutex_unlock(&s.mutex);
+}
+
+/* Worker: wait until n floats are readable or the stream has ended. */
+static void
+waitFor(Stream &s, size_t n)
+{
+    if (s.audio.getReadSpace() >= n) return;
+    pthread_mutex_lock(&s.mutex);
+    while (s.audio.getReadSpace() < n && !__atomic_load_n(&s.eof, __ATOMIC_ACQUIRE)) {
+        pthread_cond_wait(&s.cond, &s.mutex);
+    }
+    pthread_mutex_unlock(&s.mutex);
+}
+
+/* Worker: read count sample frames mixed down to mono, zero filling at the end. */
+static void
+readMono(Stream &s, vector<float> &interleaved, float *out, size_t count)
+{
+    size_t channels = s.request.channels;
+    waitFor(s, count * channels);
+    size_t got = s.audio.read(&interleaved[0],
+                              std::min(count, s.audio.getReadSpace() / channels) * channels);
+    got /= channels;
+    for (size_t i = 0; i < got; ++i) {
+        float sum = 0.0f;
+        for (size_t c = 0; c < channels; ++c) {
+            sum += interleaved[i * channels + c];
+        }
+        out[i] = sum / channels;
+    }
+    for (size_t i = got; i < count; ++i) out[i] = 0.0f;
+}
+
+static bool
+sendAll(int fd, const void *data, size_t n)
+{
+    const char *p = (const char *)data;
+    while (n > 0) {
+        ssize_t sent = send(fd, p, n, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        p += sent;
+        n -= sent;
+    }
+    return true;
+}
+
+static void *
+streamWorker(void *arg)
+{
+    Stream &s = *(Stream *)arg;
+    const size_t stepSize = s.stepSize, blockSize = s.blockSize;
+    const float sampleRate = s.request.sampleRate;
+
+    FrameTransform transform(blockSize);
+    vector<float> interleaved(blockSize * s.request.channels);
+    vector<float> block(blockSize, 0.0f);
+
+    // Prime all but the last step of the first block, as bregman-batch does
+    readMono(s, interleaved, &block[stepSize], blockSize - stepSize);
+
+    for (uint64_t frame = 0; ; ++frame) {
+        waitFor(s, stepSize * s.request.channels);
+        if (__atomic_load_n(&s.eof, __ATOMIC_ACQUIRE) &&
+            frame * stepSize >= __atomic_load_n(&s.received, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        memmove(&block[0], &block[stepSize], (blockSize - stepSize) * sizeof(float));
+        readMono(s, interleaved, &block[blockSize - stepSize], stepSize);
+
+        const float *spectrum = transform.process(&block[0]);
+        Vamp::RealTime rt = Vamp::RealTime::frame2RealTime(frame * stepSize, sampleRate);
+        Dissonance::FeatureSet fs = s.plugin->process(&spectrum, rt);
+
+        StreamResult result;
+        memset(&result, 0, sizeof(result));
+        result.frame = frame;
+        result.time = double(frame * stepSize) / sampleRate;
+        result.dissonance = std::numeric_limits<float>::quiet_NaN();
+        if (!fs[0].empty() && !fs[0][0].values.empty()) {
+            result.dissonance = fs[0][0].values[0];
+        }
+
+        // the arrival of the last real sample this frame depended on
+        uint64_t needed = std::min(uint64_t(frame * stepSize + blockSize),
+                                   __atomic_load_n(&s.received, __ATOMIC_ACQUIRE));
+        while (s.arrivals.getReadSpace() > 1 && s.arrivals.front().end < needed) {
+            s.arrivals.pop();
+        }
+        double arrived = (s.arrivals.getReadSpace() ? s.arrivals.front().when : now());
+        result.backlog = s.audio.getReadSpace() / s.request.channels;
+        result.latency = (now() - arrived) * 1000.0;
+
+        ++s.frames;
+        s.latencySum += result.latency;
+        s.latencyMax = std::max(s.latencyMax, double(result.latency));
+        s.backlogMax = std::max(s.backlogMax, size_t(result.backlog));
+
+        if (!sendAll(s.fd, &result, sizeof(result))) break;
+    }
+
+    shutdown(s.fd, SHUT_WR);
+    __atomic_store_n(&s.done, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* A connection whose StreamRequest has not all arrived yet. */
+struct Handshake
+{
+    int fd;
+    size_t id;
+    double since;
+    StreamRequest request;
+    size_t bytes;
+};
+
+/* Input thread: read what has arrived of a request.  False on failure. */
+static bool
+readRequest(Handshake &h)
+{
+    ssize_t got = recv(h.fd, (char *)&h.request + h.bytes,
+                       sizeof(h.request) - h.bytes, MSG_DONTWAIT);
+    if (got < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    }
+    if (got <= 0) return false;
+    h.bytes += got;
+    return true;
+}
+
+/* Input thread: answer a complete request.  Returns 0 on failure. */
+static Stream *
+openStream(int fd, const StreamRequest &request, size_t id)
+{
+    StreamReply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = STREAM_MAGIC;
+
+    if (request.magic != STREAM_MAGIC || request.version != STREAM_VERSION) {
+        reply.status = STREAM_ERROR_PROTOCOL;
+        sendAll(fd, &reply, sizeof(reply));
+        return 0;
+    }
+
+    // bounds first, so that nothing below is sized from a wild request
+    reply.stepSize = request.stepSize;
+    reply.blockSize = request.blockSize;
+    if (request.channels < 1 || request.channels > STREAM_MAX_CHANNELS ||
+        !(request.sampleRate > 0) || !(request.sampleRate <= STREAM_MAX_SAMPLE_RATE) ||
+        request.blockSize > STREAM_MAX_BLOCK_SIZE) {
+        reply.status = STREAM_ERROR_PARAMETERS;
+        sendAll(fd, &reply, sizeof(reply));
+        return 0;
+    }
+
+    Dissonance *plugin = 0;
+    Stream *s = 0;
+    try {
+        plugin = new Dissonance(request.sampleRate);
+        size_t step = request.stepSize ? request.stepSize : plugin->getPreferredStepSize();
+        size_t block = request.blockSize ? request.blockSize : plugin->getPreferredBlockSize();
+        reply.stepSize = step;
+        reply.blockSize = block;
+        if ((block & (block - 1)) || step > block ||
+            !plugin->initialise(1, step, block)) {
+            delete plugin;
+            reply.status = STREAM_ERROR_PARAMETERS;
+            sendAll(fd, &reply, sizeof(reply));
+            return 0;
+        }
+        s = new Stream(fd, request, step, block, plugin, id);
+    } catch (const std::bad_alloc &) {
+        delete plugin;
+        cerr << "ERROR: bregman-daemon: out of memory for stream " << id << endl;
+        reply.status = STREAM_ERROR_RESOURCES;
+        sendAll(fd, &reply, sizeof(reply));
+        return 0;
+    }
+
+    if (!sendAll(fd, &reply, sizeof(reply))) {
+        delete s;
+        return 0;
+    }
+    return s;
+}
+
+/* Input thread: read what is waiting on a client socket into its ring. */
+static void
+readStream(Stream &s, vector<char> &buffer)
+{
+    size_t room = s.audio.getWriteSpace() * sizeof(float) - s.partialBytes;
+    memcpy(&buffer[0], s.partial, s.partialBytes);
+    ssize_t got = recv(s.fd, &buffer[s.partialBytes],
+                       std::min(room, buffer.size() - s.partialBytes), 0);
+    if (got < 0 && (errno == EINTR || errno == EAGAIN)) return;
+    if (got <= 0) {
+        __atomic_store_n(&s.eof, 1, __ATOMIC_RELEASE);
+        wake(s);
+        return;
+    }
+
+    size_t bytes = s.partialBytes + got;
+    size_t n = bytes / sizeof(float);
+    s.partialBytes = bytes - n * sizeof(float);
+    memcpy(s.partial, &buffer[n * sizeof(float)], s.partialBytes);
+
+    // the arrival mark goes first, so the worker always finds one
+    s.floats += n;
+    Arrival a;
+    a.end = s.floats / s.request.channels;
+    a.when = now();
+    s.arrivals.write(&a, 1);
+    s.audio.write((const float *)&buffer[0], n);
+    __atomic_store_n(&s.received, a.end, __ATOMIC_RELEASE);
+    wake(s);
+}
+
+static volatile sig_atomic_t quitting = 0;
+
+static void
+onSignal(int)
+{
+    quitting = 1;
+}
+
+static void
+usage(const char *name)
+{
+    cerr << "usage: " << name << " [-S socket]" << endl
+         << endl
+         << "  Serves streaming Dissonance analysis on a Unix domain socket to" << endl
+         << "  any number of concurrent clients (see bregman-client)." << endl
+         << endl
+         << "  -S socket  socket path (default: " << STREAM_DEFAULT_SOCKET << ")" << endl;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *name = argv[0];
+    string path = STREAM_DEFAULT_SOCKET;
+
+    int c;
+    while ((c = getopt(argc, argv, "S:h")) != -1) {
+        switch (c) {
+        case 'S': path = optarg; break;
+        default: usage(name); return 2;
+        }
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        cerr << "ERROR: bregman-daemon: socket path too long" << endl;
+        return 2;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str());
+    if (listener < 0 ||
+        bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listener, 16) != 0) {
+        cerr << "ERROR: bregman-daemon: cannot listen on \"" << path << "\": "
+             << strerror(errno) << endl;
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    cerr << "bregman-daemon: listening on " << path << endl;
+
+    vector<Stream *> streams;
+    vector<Handshake> handshakes;
+    vector<char> buffer(READ_BUFFER_BYTES);
+    vector<struct pollfd> fds;
+    vector<Stream *> polled;
+    size_t nextId = 0;
+
+    while (!quitting) {
+        fds.clear();
+        polled.clear();
+        struct pollfd pfd;
+        pfd.fd = listener;
+        pfd.events = POLLIN;
+        fds.push_back(pfd);
+        for (size_t i = 0; i < streams.size(); ++i) {
+            Stream &s = *streams[i];
+            // a full ring is back-pressure: leave the data in the socket
+            if (s.eof ||
+                s.audio.getWriteSpace() * sizeof(float) <= s.partialBytes ||
+                s.arrivals.getWriteSpace() == 0) continue;
+            pfd.fd = s.fd;
+            fds.push_back(pfd);
+            polled.push_back(&s);
+        }
+        for (size_t i = 0; i < handshakes.size(); ++i) {
+            pfd.fd = handshakes[i].fd;
+            fds.push_back(pfd);
+        }
+
+        if (poll(&fds[0], fds.size(), POLL_INTERVAL_MS) < 0 && errno != EINTR) {
+            perror("bregman-daemon: poll");
+            break;
+        }
+
+        for (size_t i = 0; i < polled.size(); ++i) {
+            if (fds[i+1].revents) readStream(*polled[i], buffer);
+        }
+
+        // fds past the streams are the handshakes, in order
+        double t = now();
+        for (size_t i = 0, j = polled.size() + 1; i < handshakes.size(); ++j) {
+            Handshake h = handshakes[i];
+            bool failed = (fds[j].revents && !readRequest(h));
+            if (!failed && h.bytes < sizeof(h.request) && t - h.since < HANDSHAKE_TIMEOUT_S) {
+                handshakes[i++] = h;
+                continue;
+            }
+            handshakes.erase(handshakes.begin() + i);
+
+            Stream *s = 0;
+            if (h.bytes == sizeof(h.request)) {
+                s = openStream(h.fd, h.request, h.id);
+            } else if (!failed) {
+                StreamReply reply;
+                memset(&reply, 0, sizeof(reply));
+                reply.magic = STREAM_MAGIC;
+                reply.status = STREAM_ERROR_PROTOCOL;
+                sendAll(h.fd, &reply, sizeof(reply));
+            }
+            if (s && pthread_create(&s->worker, 0, streamWorker, s) == 0) {
+                streams.push_back(s);
+                cerr << "stream " << s->id << ": " << s->request.channels << " channels at "
+                     << s->request.sampleRate << " Hz, step " << s->stepSize
+                     << ", block " << s->blockSize << endl;
+            } else {
+                delete s;
+                close(h.fd);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, 0, 0);
+            if (fd >= 0) {
+                Handshake h;
+                h.fd = fd;
+                h.id = nextId++;
+                h.since = now();
+                h.bytes = 0;
+                handshakes.push_back(h);
+            }
+        }
+
+        for (size_t i = 0; i < streams.size(); ) {
+            Stream *s = streams[i];
+            if (!__atomic_load_n(&s->done, __ATOMIC_ACQUIRE)) {
+                ++i;
+                continue;
+            }
+            pthread_join(s->worker, 0);
+            cerr << "stream " << s->id << ": " << s->frames << " frames, latency mean "
+                 << (s->frames ? s->latencySum / s->frames : 0.0) << " ms, max "
+                 << s->latencyMax << " ms, backlog max " << s->backlogMax
+                 << " samples" << endl;
+            close(s->fd);
+            delete s;
+            streams.erase(streams.begin() + i);
+        }
+    }
+
+    // let workers finish what they have, then go
+    for (size_t i = 0; i < streams.size(); ++i) {
+        shutdown(streams[i]->fd, SHUT_RD);
+        __atomic_store_n(&streams[i]->eof, 1, __ATOMIC_RELEASE);
+        wake(*streams[i]);
+        pthread_join(streams[i]->worker, 0);
+        close(streams[i]->fd);
+        delete streams[i];
+    }
+    for (size_t i = 0; i < handshakes.size(); ++i) {
+        close(handshakes[i].fd);
+    }
+    close(listener);
+    unlink(path.c_str());
+    return 0;
+}
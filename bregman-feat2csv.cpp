@@ -0,0 +1,107 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * bregman-feat2csv -
+ * Converts a columnar FeatureFile (.bfeat) to CSV, one row per frame:
+ * timestamp followed by every bin of every output (or just -o output).
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "FeatureFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using std::cerr;
+using std::endl;
+
+static void
+usage(const char *name)
+{
+    cerr << "usage: " << name << " [-o output] [-H] file.bfeat [out.csv]" << endl
+         << endl
+         << "  -o output  write only the named output" << endl
+         << "  -H         omit the header row" << endl;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *name = argv[0];
+    string only;
+    bool header = true;
+
+    int c;
+    while ((c = getopt(argc, argv, "o:Hh")) != -1) {
+        switch (c) {
+        case 'o': only = optarg; break;
+        case 'H': header = false; break;
+        default: usage(name); return 2;
+        }
+    }
+    if (optind >= argc || argc - optind > 2) {
+        usage(name);
+        return 2;
+    }
+
+    FeatureFileReader reader;
+    if (!reader.open(argv[optind])) {
+        cerr << "ERROR: " << name << ": " << reader.getError() << endl;
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (argc - optind == 2) {
+        out = fopen(argv[optind + 1], "w");
+        if (!out) {
+            perror(argv[optind + 1]);
+            return 1;
+        }
+    }
+
+    // Collect the columns to write, in file order
+    vector<const float *> columns;
+    vector<string> names;
+    for (size_t o = 0; o < reader.getOutputCount(); ++o) {
+        const FeatureFileOutput &output = reader.getOutput(o);
+        string id(output.identifier);
+        if (only != "" && id != only) continue;
+        for (size_t b = 0; b < output.binCount; ++b) {
+            columns.push_back(reader.getColumn(o, b));
+            if (output.binCount == 1) names.push_back(id);
+            else names.push_back(id + ":" + std::to_string((unsigned long long)b));
+        }
+    }
+    if (only != "" && columns.empty()) {
+        cerr << "ERROR: " << name << ": no output \"" << only << "\" in "
+             << argv[optind] << endl;
+        return 1;
+    }
+
+    if (header) {
+        fprintf(out, "timestamp");
+        for (size_t i = 0; i < names.size(); ++i) fprintf(out, ",%s", names[i].c_str());
+        fprintf(out, "\n");
+    }
+    for (size_t f = 0; f < reader.getFrameCount(); ++f) {
+        fprintf(out, "%.9f", reader.getFrameTime(f));
+        for (size_t i = 0; i < columns.size(); ++i) fprintf(out, ",%.9g", columns[i][f]);
+        fprintf(out, "\n");
+    }
+
+    if (out != stdout && fclose(out) != 0) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    return 0;
+}
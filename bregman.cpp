@@ -0,0 +1,240 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * libbregman -
+ * A plain C interface to the Bregman dissonance analysis, for programs
+ * that want the analysis without hosting a Vamp plugin.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#include "bregman.h"
+#include "DissonanceModel.h"
+#include "SpectralFrontEnd.h"
+#include "DenormalGuard.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+using std::vector;
+
+/* Default number of partials entering the dissonance sum, as the plugin */
+#define DEFAULT_PARTIALS 20
+
+/*
+ * The front end with its frames and the partials of the frame being
+ * evaluated.  The peak picking is that of the Dissonance plugin with
+ * partial tracking off, so results match its "lineardissonance".
+ */
+struct bregman_context
+{
+    SpectralFrontEnd frontEnd;
+    SpectralFrame frames[SpectralFrontEnd::Lanes];
+    vector<FreqSortPair> partials;
+    size_t numPartials;
+    DissonanceModel model;
+};
+
+static void
+toModel(const bregman_model *m, DissonanceModel &model)
+{
+    model.b1 = m->b1; model.b2 = m->b2;
+    model.s1 = m->s1; model.s2 = m->s2;
+    model.c1 = m->c1; model.c2 = m->c2;
+    model.Dstar = m->dstar;
+    model.pruning = m->pruning;
+}
+
+static void
+fromModel(const DissonanceModel &model, bregman_model *m)
+{
+    m->b1 = model.b1; m->b2 = model.b2;
+    m->s1 = model.s1; m->s2 = model.s2;
+    m->c1 = model.c1; m->c2 = model.c2;
+    m->dstar = model.Dstar;
+    m->pruning = model.pruning;
+}
+
+/* Peak picking on an analysed frame, into ctx->partials */
+static void
+pickPartials(bregman_context *ctx, const SpectralFrame &frame)
+{
+    SpectralFrontEnd &fe = ctx->frontEnd;
+    size_t npeaks = fe.findPeaks(frame);
+    fe.selectPartials(fe.getPeakBins(), fe.getPeakMags(), npeaks,
+                      ctx->numPartials, ctx->partials);
+}
+
+static float
+evaluate(const bregman_context *ctx)
+{
+    const vector<FreqSortPair> &p = ctx->partials;
+    return ctx->model.evaluate(p.empty() ? 0 : &p[0], p.size());
+}
+
+extern "C" {
+
+int
+bregman_api_version(void)
+{
+    return BREGMAN_API_VERSION;
+}
+
+void
+bregman_default_model(bregman_model *model)
+{
+    if (model) fromModel(DissonanceModel(), model);
+}
+
+bregman_context *
+bregman_create(float sample_rate, size_t block_size)
+{
+    if (!(sample_rate > 0.0f) || block_size < 2 || block_size % 2) return 0;
+
+    // no exceptions may cross into C callers
+    bregman_context *ctx = 0;
+    try {
+        ctx = new bregman_context;
+        ctx->frontEnd.initialise(sample_rate, block_size);
+        ctx->partials.reserve(DEFAULT_PARTIALS);
+        ctx->numPartials = DEFAULT_PARTIALS;
+    } catch (const std::bad_alloc &) {
+        delete ctx;
+        return 0;
+    }
+    return ctx;
+}
+
+void
+bregman_destroy(bregman_context *ctx)
+{
+    delete ctx;
+}
+
+int
+bregman_set_band(bregman_context *ctx, float min_freq, float max_freq)
+{
+    if (!ctx || !(min_freq >= 0.0f) || !(max_freq >= min_freq)) {
+        return BREGMAN_ERROR_ARGUMENT;
+    }
+    ctx->frontEnd.setBand(min_freq, max_freq);
+    return BREGMAN_OK;
+}
+
+int
+bregman_set_partial_count(bregman_context *ctx, size_t count)
+{
+    if (!ctx || count < 1) return BREGMAN_ERROR_ARGUMENT;
+    try {
+        ctx->partials.reserve(count);
+    } catch (const std::bad_alloc &) {
+        return BREGMAN_ERROR_MEMORY;
+    }
+    ctx->numPartials = count;
+    return BREGMAN_OK;
+}
+
+int
+bregman_set_decimation(bregman_context *ctx, size_t factor)
+{
+    if (!ctx || factor < 1 || factor > SpectralFrontEnd::MaxDecimation) {
+        return BREGMAN_ERROR_ARGUMENT;
+    }
+    ctx->frontEnd.setDecimation(factor);
+    return BREGMAN_OK;
+}
+
+int
+bregman_set_model(bregman_context *ctx, const bregman_model *model)
+{
+    if (!ctx || !model) return BREGMAN_ERROR_ARGUMENT;
+    toModel(model, ctx->model);
+    return BREGMAN_OK;
+}
+
+int
+bregman_get_model(const bregman_context *ctx, bregman_model *model)
+{
+    if (!ctx || !model) return BREGMAN_ERROR_ARGUMENT;
+    fromModel(ctx->model, model);
+    return BREGMAN_OK;
+}
+
+int
+bregman_find_partials(bregman_context *ctx, const float *spectrum,
+                      bregman_partial *partials, size_t max_partials,
+                      size_t *count)
+{
+    if (!ctx || !spectrum || (!partials && max_partials) || !count) {
+        return BREGMAN_ERROR_ARGUMENT;
+    }
+    try {
+        DenormalGuard guard;
+        ctx->frontEnd.analyse(spectrum, ctx->frames[0]);
+        pickPartials(ctx, ctx->frames[0]);
+    } catch (const std::bad_alloc &) {
+        return BREGMAN_ERROR_MEMORY;
+    }
+    size_t n = std::min(max_partials, ctx->partials.size());
+    for (size_t i = 0; i < n; ++i) {
+        partials[i].freq = ctx->partials[i].first;
+        partials[i].mag = ctx->partials[i].second;
+    }
+    *count = n;
+    return BREGMAN_OK;
+}
+
+int
+bregman_dissonance(bregman_context *ctx, const float *spectrum, float *dissonance)
+{
+    return bregman_dissonance_frames(ctx, &spectrum, 1, dissonance);
+}
+
+int
+bregman_dissonance_frames(bregman_context *ctx, const float *const *spectra,
+                          size_t count, float *dissonance)
+{
+    if (!ctx || (count && (!spectra || !dissonance))) return BREGMAN_ERROR_ARGUMENT;
+    for (size_t i = 0; i < count; ++i) {
+        if (!spectra[i]) return BREGMAN_ERROR_ARGUMENT;
+    }
+    try {
+        DenormalGuard guard;
+        for (size_t f = 0; f < count; f += SpectralFrontEnd::Lanes) {
+            size_t n = std::min(count - f, SpectralFrontEnd::Lanes);
+            ctx->frontEnd.analyse(spectra + f, n, ctx->frames);
+            for (size_t l = 0; l < n; ++l) {
+                pickPartials(ctx, ctx->frames[l]);
+                dissonance[f + l] = evaluate(ctx);
+            }
+        }
+    } catch (const std::bad_alloc &) {
+        return BREGMAN_ERROR_MEMORY;
+    }
+    return BREGMAN_OK;
+}
+
+int
+bregman_dissonance_partials(const bregman_partial *partials, size_t count,
+                            const bregman_model *model, float *dissonance)
+{
+    if ((!partials && count) || !dissonance) return BREGMAN_ERROR_ARGUMENT;
+    DissonanceModel m;
+    if (model) toModel(model, m);
+    try {
+        vector<FreqSortPair> p(count);
+        for (size_t i = 0; i < count; ++i) {
+            p[i] = FreqSortPair(partials[i].freq, partials[i].mag);
+        }
+        DenormalGuard guard;
+        *dissonance = m.evaluate(p.empty() ? 0 : &p[0], count);
+    } catch (const std::bad_alloc &) {
+        return BREGMAN_ERROR_MEMORY;
+    }
+    return BREGMAN_OK;
+}
+
+}
@@ -0,0 +1,117 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*-  vi:set ts=8 sts=4 sw=4: */
+
+/*
+ *
+ * libbregman -
+ * A plain C interface to the Bregman dissonance analysis, for programs
+ * that want the analysis without hosting a Vamp plugin.
+ *
+ * Author: Michael A. Casey, Dartmouth College, USA (2015)
+ *
+ */
+
+#ifndef _BREGMAN_H_
+#define _BREGMAN_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Version of this interface.  Functions and structures are only ever
+ * added; an existing signature or structure layout never changes
+ * within a major version.
+ */
+#define BREGMAN_API_VERSION 1
+
+/* Status codes returned by the functions below */
+#define BREGMAN_OK                0
+#define BREGMAN_ERROR_ARGUMENT   -1  /* null pointer or value out of range */
+#define BREGMAN_ERROR_MEMORY     -2  /* allocation failed */
+
+/* Analysis state for one sample rate and block size (opaque) */
+typedef struct bregman_context bregman_context;
+
+/* A spectral partial: frequency in Hz, linear magnitude */
+typedef struct bregman_partial {
+    float freq;
+    float mag;
+} bregman_partial;
+
+/*
+ * Constants of the Sethares dissonance model; see DissonanceModel.h.
+ * pruning > 0 skips pairs of partials further apart than that many
+ * critical bandwidths.
+ */
+typedef struct bregman_model {
+    float b1, b2, s1, s2, c1, c2, dstar;
+    float pruning;
+} bregman_model;
+
+/* BREGMAN_API_VERSION of the library actually linked */
+int bregman_api_version(void);
+
+/* Fill model with the defaults of Sethares (1993), without pruning */
+void bregman_default_model(bregman_model *model);
+
+/*
+ * Create a context for spectra of block_size-sample blocks (block_size
+ * even) at sample_rate Hz, with the default model, band and partial
+ * count of the Vamp plugin.  Returns NULL on failure.  A context may be
+ * used by one thread at a time; contexts are independent.
+ */
+bregman_context *bregman_create(float sample_rate, size_t block_size);
+void bregman_destroy(bregman_context *ctx);
+
+/* Search for partials between min_freq and max_freq Hz only */
+int bregman_set_band(bregman_context *ctx, float min_freq, float max_freq);
+
+/* Number of the strongest peaks entering the dissonance sum (default 20) */
+int bregman_set_partial_count(bregman_context *ctx, size_t count);
+
+/* Smooth only every factor'th bin (1 to 4, default 1); see the README */
+int bregman_set_decimation(bregman_context *ctx, size_t factor);
+
+int bregman_set_model(bregman_context *ctx, const bregman_model *model);
+int bregman_get_model(const bregman_context *ctx, bregman_model *model);
+
+/*
+ * The functions below take spectra as block_size/2 + 1 interleaved
+ * re/im pairs, the layout of Vamp frequency-domain input.
+ */
+
+/*
+ * The partials picked from spectrum, sorted by ascending frequency.
+ * At most max_partials are written to partials; *count receives the
+ * number written.
+ */
+int bregman_find_partials(bregman_context *ctx, const float *spectrum,
+                          bregman_partial *partials, size_t max_partials,
+                          size_t *count);
+
+/* The dissonance of spectrum, as the plugin's "lineardissonance" output */
+int bregman_dissonance(bregman_context *ctx, const float *spectrum,
+                       float *dissonance);
+
+/*
+ * bregman_dissonance() of count spectra, into dissonance[0..count-1].
+ * Spectra are smoothed several at a time, so this is faster than
+ * separate calls.
+ */
+int bregman_dissonance_frames(bregman_context *ctx, const float *const *spectra,
+                              size_t count, float *dissonance);
+
+/*
+ * The dissonance of count partials sorted by ascending frequency under
+ * model (the defaults if NULL).  Needs no context.
+ */
+int bregman_dissonance_partials(const bregman_partial *partials, size_t count,
+                                const bregman_model *model, float *dissonance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,9 +33,30 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <float.h>
 #include "iirfilter.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define APFILTER_MXCSR 1
+#endif
+#endif
+
+/* apfilter() segmentation: segments are filtered APFILTER_LANES at a
+ * time by a FILTERBANK, and are long enough that the serial correction
+ * (the filter's zero-input response, a few hundred samples for a
+ * low-order smoother) is a small part of each.  The segment count
+ * depends on the input length alone, so results do not depend on the
+ * number of threads.
+ */
+#define APFILTER_LANES 16
+#define APFILTER_MIN_SEGMENT 4096
+#define APFILTER_MAX_BANKS 64
+
 
 static sampleT readFilter(FILTER*, int);
 static void insertFilter(FILTER*,sampleT);
@@ -57,6 +78,7 @@ static void sortRoots(fcomplex roots[], int dim);
 static int sortfun(fpolar *a, fpolar *b);
 static void nudgeMags(fpolar a[], fcomplex b[], int dim, sampleT fact);
 static void nudgePhases(fpolar a[], fcomplex b[], int dim, sampleT fact);
+static int updateZCoeffs(ZFILTER* p);
 
 static void zroots(fcomplex [], int, fcomplex []);
 static fcomplex Cadd(fcomplex, fcomplex);
@@ -144,6 +166,12 @@ int izfilter(ZFILTER *p)
 
     /* Sort roots into descending order of magnitudes */
     sortRoots(roots, dim);
+
+    /* The a coefficients are those of the un-nudged roots; callers
+     * opt in to interpolation after initialisation
+     */
+    p->coeffsValid = 0;
+    p->interpolate = 0;
     return OK;
 }
 
@@ -151,6 +179,9 @@ void free_zfilter(ZFILTER* p){
   if(p->delay!=NULL){
     free(p->delay);
   }
+  if(p->roots!=NULL){
+    free(p->roots);
+  }
   free(p);
 }
 
@@ -208,6 +239,277 @@ int afilter(FILTER* p, uint32_t nsmps)
     return OK;
 }
 
+/* arfilter -- afilter() running backwards through memory
+ *
+ * As afilter(), but in and out point at the first sample processed and
+ * each later sample lies one place below the one before: sample n is
+ * read from in[-n] and written to out[-n].  This filters a signal in
+ * reverse without copying it into reversed order, with outputs
+ * identical to afilter() on the reversed copy.  in may equal out.
+ */
+int arfilter(FILTER* p, uint32_t nsmps)
+{
+    int      i;
+    uint32_t n;
+
+    sampleT* a = p->coeffs+p->numb;
+    sampleT* b = p->coeffs+1;
+    sampleT  b0 = p->coeffs[0];
+
+    sampleT poleSamp, zeroSamp;
+
+    for (n=0; n<nsmps; n++) {
+
+      poleSamp = p->in[-(int32_t)n];
+      zeroSamp = 0.0;
+
+      for (i=0; i< p->ndelay; i++) {
+        if (i<p->numa)
+          poleSamp += -(a[i])*readFilter(p,i+1);
+        if (i<(p->numb-1))
+          zeroSamp += (b[i])*readFilter(p,i+1);
+      }
+
+      p->out[-(int32_t)n] = (b0)*poleSamp + zeroSamp;
+      insertFilter(p, poleSamp);
+    }
+    return OK;
+}
+
+/* apfilter -- afilter() evaluated over parallel segments
+ *
+ * The recurrence is linear, so the output over a segment is the output
+ * from zero state plus the response to the state left by the segment
+ * before.  The nsmps samples are split into segments that are first
+ * filtered from zero state side by side, as the lanes of FILTERBANKs
+ * (one bank per OpenMP thread when built with OpenMP).  A serial pass
+ * then propagates the true state from each segment into the next,
+ * adding its zero-input response to the segment's outputs only until
+ * that response decays below FLT_EPSILON^2 of the state it started
+ * from (or below FLT_MIN), well under the rounding error of afilter()
+ * itself, and before it can reach subnormal values.  The outputs equal
+ * afilter()'s up to rounding, not bit for bit.
+ *
+ * dir is 1 to run up through memory as afilter() does, or -1 to run
+ * down as arfilter() does.  The delay line supplies the initial state
+ * and is left as afilter() would leave it.  Inputs too short to split
+ * are passed to afilter() or arfilter().  in may equal out.
+ */
+int apfilter(FILTER* p, uint32_t nsmps, int dir)
+{
+    const int lanes = APFILTER_LANES;
+    int      i, k, b, banks, nseg;
+    uint32_t n, len, pad;
+    sampleT* a = p->coeffs+p->numb;
+    sampleT* bz = p->coeffs+1;
+    sampleT  b0 = p->coeffs[0];
+    sampleT *buf, *zstate;
+    FILTERBANK* bank;
+    sampleT hist[MAXPOLES+MAXZEROS+1];
+    sampleT poleSamp, zeroSamp, mag, tiny;
+#ifdef APFILTER_MXCSR
+    unsigned int csr = _mm_getcsr(), flags = 0;
+#endif
+
+    banks = (int)MIN(nsmps / ((uint32_t)lanes*APFILTER_MIN_SEGMENT), APFILTER_MAX_BANKS);
+    if (banks < 1 || p->ndelay < 1)
+      return (dir < 0 ? arfilter(p, nsmps) : afilter(p, nsmps));
+
+    /* Segments of len samples; the pad samples short of nseg*len are
+     * zeros ahead of the first, which from zero state leave it at zero
+     */
+    nseg = banks*lanes;
+    len = (nsmps + nseg - 1) / nseg;
+    pad = (uint32_t)nseg*len - nsmps;
+    buf = (sampleT*) malloc((size_t)nseg*len*sizeof(sampleT));
+    zstate = (sampleT*) malloc((size_t)nseg*p->ndelay*sizeof(sampleT));
+    bank = (FILTERBANK*) calloc(banks, sizeof(FILTERBANK));
+
+    /* Banks are set up here, where a failure can still fall back to
+     * the serial filter, rather than in the parallel pass
+     */
+    b = 0;
+    if (buf != NULL && zstate != NULL && bank != NULL)
+      for (; b<banks; b++) {
+        memcpy(bank[b].coeffs, p->coeffs, sizeof(bank[b].coeffs));
+        bank[b].numa = p->numa;
+        bank[b].numb = p->numb;
+        bank[b].lanes = lanes;
+        bank[b].in = buf + (size_t)b*len*lanes;
+        bank[b].out = bank[b].in;
+        if (ifilterbank(&bank[b]) != OK)
+          break;
+      }
+    if (b < banks) {
+      if (bank != NULL)
+        for (i=0; i<b; i++)
+          free(bank[i].delay);
+      free(bank);
+      free(buf);
+      free(zstate);
+      return (dir < 0 ? arfilter(p, nsmps) : afilter(p, nsmps));
+    }
+
+    /* Zero-state pass, each bank's segments lane-interleaved in place */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) private(i, k, n)
+#endif
+    for (b=0; b<banks; b++) {
+      FILTERBANK* fb = &bank[b];
+      sampleT* seg = fb->in;
+#ifdef APFILTER_MXCSR
+      /* run with the caller's flush-to-zero mode, and hand back flags */
+      unsigned int saved = _mm_getcsr();
+      _mm_setcsr(csr);
+#endif
+      for (n=0; n<len; n++)
+        for (k=0; k<lanes; k++) {
+          int64_t g = (int64_t)(b*lanes + k)*len + n - pad;
+          seg[(size_t)n*lanes + k] = (g < 0 ? 0.0f : p->in[dir*g]);
+        }
+
+      afilterbank(fb, len);
+      for (k=0; k<lanes; k++)
+        for (i=0; i<p->ndelay; i++) {
+          int slot = fb->currPos - (i+1);
+          if (slot < 0) slot += fb->ndelay;
+          zstate[(size_t)(b*lanes + k)*p->ndelay + i] = fb->delay[(size_t)slot*lanes + k];
+        }
+      free(fb->delay);
+#ifdef APFILTER_MXCSR
+#ifdef _OPENMP
+#pragma omp atomic
+#endif
+      flags |= _mm_getcsr() & 0x3f;
+      _mm_setcsr(saved);
+#endif
+    }
+#ifdef APFILTER_MXCSR
+    _mm_setcsr(_mm_getcsr() | flags);
+#endif
+
+    /* Serial pass: hist holds the pole-signal correction w(n-1-i),
+     * starting from the true state at the start of each segment
+     */
+    for (i=0; i<p->ndelay; i++)
+      hist[i] = readFilter(p, i+1);
+    for (k=0; k<nseg; k++) {
+      sampleT* seg = buf + (size_t)(k/lanes)*len*lanes + k%lanes;
+      const sampleT* z = zstate + (size_t)k*p->ndelay;
+
+      tiny = 0.0;
+      for (i=0; i<p->ndelay; i++)
+        tiny = MAX(tiny, fabsf(hist[i]));
+      tiny = MAX(tiny*FLT_EPSILON*FLT_EPSILON, FLT_MIN);
+
+      for (n=(k == 0 ? pad : 0); n<len; n++) {
+        poleSamp = 0.0;
+        zeroSamp = 0.0;
+        for (i=0; i< p->ndelay; i++) {
+          if (i<p->numa)
+            poleSamp += -(a[i])*hist[i];
+          if (i<(p->numb-1))
+            zeroSamp += (bz[i])*hist[i];
+        }
+        seg[(size_t)n*lanes] += (b0)*poleSamp + zeroSamp;
+
+        mag = fabsf(poleSamp);
+        for (i=p->ndelay-1; i>0; i--) {
+          hist[i] = hist[i-1];
+          mag = MAX(mag, fabsf(hist[i]));
+        }
+        hist[0] = poleSamp;
+        if (mag < tiny)
+          break;
+      }
+
+      /* true state at the end of the segment */
+      for (i=0; i<p->ndelay; i++)
+        hist[i] = z[i] + (n < len ? 0.0f : hist[i]);
+    }
+
+    for (i=p->ndelay-1; i>=0; i--)
+      insertFilter(p, hist[i]);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) private(k, n)
+#endif
+    for (b=0; b<banks; b++) {
+      const sampleT* seg = buf + (size_t)b*len*lanes;
+      for (n=0; n<len; n++)
+        for (k=0; k<lanes; k++) {
+          int64_t g = (int64_t)(b*lanes + k)*len + n - pad;
+          if (g >= 0)
+            p->out[dir*g] = seg[(size_t)n*lanes + k];
+        }
+    }
+
+    free(bank);
+    free(buf);
+    free(zstate);
+    return OK;
+}
+
+/* afilterout -- numerator of the filter at one sample
+ *
+ * Forms b(0)*w(n) + b(1)*w(n-1) + ... + b(nb)*w(n-nb) from the pole
+ * signal w, the values afilter() inserts in its delay line, with w
+ * pointing at w(n).  This is afilter()'s output at n, bit for bit.
+ */
+sampleT afilterout(const sampleT* coeffs, int numb, const sampleT* w)
+{
+    int i;
+    const sampleT* b = coeffs+1;
+    sampleT zeroSamp = 0.0;
+
+    for (i=0; i<(numb-1); i++)
+      zeroSamp += (b[i])*w[-1-i];
+
+    return (coeffs[0])*w[0] + zeroSamp;
+}
+
+/* adfilter -- a-rate filter keeping every factor'th output
+ *
+ * The pole recursion runs at every sample, as it must, but the zeros are
+ * summed only for outputs n = 0, factor, 2*factor, ..., which are
+ * written to out[n/factor] and equal afilter()'s outputs exactly.
+ *
+ * The pole signal w of every sample is written to state[ndelay + n],
+ * after the ndelay values held in the delay line on entry, so that any
+ * skipped output n can be formed later with
+ * afilterout(coeffs, numb, state + ndelay + n).  state must have room
+ * for nsmps + ndelay values.  The delay line is left as afilter() would
+ * leave it.
+ */
+int adfilter(FILTER* p, uint32_t nsmps, uint32_t factor, sampleT* state)
+{
+    int      i;
+    uint32_t n;
+
+    sampleT* a = p->coeffs+p->numb;
+    sampleT* w = state + p->ndelay;
+    sampleT  poleSamp;
+
+    if (factor < 1) factor = 1;
+
+    for (i=0; i<p->ndelay; i++)
+      state[i] = readFilter(p, p->ndelay-i);
+
+    for (n=0; n<nsmps; n++) {
+      poleSamp = p->in[n];
+      for (i=0; i<p->numa; i++)
+        poleSamp += -(a[i])*w[(int)n-1-i];
+      w[n] = poleSamp;
+
+      if (n % factor == 0)
+        p->out[n/factor] = afilterout(p->coeffs, p->numb, w+n);
+    }
+
+    for (i=0; i<p->ndelay; i++)
+      insertFilter(p, w[(int)nsmps-p->ndelay+i]);
+    return OK;
+}
+
 /* k-rate filter routine
  *
  * Implements the following difference equation at the k rate
@@ -276,24 +578,26 @@ int azfilter(ZFILTER* p, uint32_t nsmps)
 
     sampleT poleSamp, zeroSamp, inSamp;
 
-    fpolar B[MAXPOLES];
-    fcomplex C[MAXPOLES+1];
-
-    fcomplex *roots = p->roots;
-    sampleT kmagf = *p->kmagf; /* Mag nudge factor */
-    sampleT kphsf = *p->kphsf; /* Phs nudge factor */
-
-    int dim = p->numa;
+    sampleT from[MAXPOLES], target[MAXPOLES], step[MAXPOLES];
+    int ramp = 0;
 
-    /* Nudge pole magnitudes */
-    complex2polar(roots,B,dim);
-    nudgeMags(B,roots,dim,kmagf);
-    nudgePhases(B,roots,dim,kphsf);
-    polar2complex(B,C,dim);
-    expandPoly(C,a,dim);
+    /* Keep the previous coefficients if they are to be interpolated */
+    if (p->interpolate && p->coeffsValid && nsmps>1) {
+      for (i=0; i<p->numa; i++)
+        from[i] = a[i];
+      ramp = 1;
+    }
 
-    /* C now contains the complex roots of the nudged filter */
-    /* and a contains their associated real coefficients. */
+    /* Re-derive a from the nudged poles only if the nudge factors moved */
+    if (updateZCoeffs(p) && ramp) {
+      for (i=0; i<p->numa; i++) {
+        target[i] = a[i];
+        step[i] = (a[i]-from[i])/nsmps;
+        a[i] = from[i];
+      }
+    }
+    else
+      ramp = 0;
 
     /* Outer loop */
     /*if (UNLIKELY(offset)) memset(p->out, '\0', offset*sizeof(sampleT));
@@ -324,6 +628,201 @@ int azfilter(ZFILTER* p, uint32_t nsmps)
 
       /* update filter delay line */
       insertFilter((FILTER*)p, poleSamp);
+
+      /* advance interpolated coefficients towards the new target */
+      if (ramp)
+        for (i=0; i<p->numa; i++)
+          a[i] += step[i];
+    }
+
+    /* land exactly on the target, whatever the rounding in the ramp */
+    if (ramp)
+      for (i=0; i<p->numa; i++)
+        a[i] = target[i];
+    return OK;
+}
+
+/* k-rate controllable pole filter
+ *
+ * As azfilter but for a single sample, sharing its coefficient cache,
+ * so that per-sample control only pays for root work when kmag or
+ * kfreq change.
+ */
+int kzfilter(ZFILTER* p)
+{
+    int i;
+
+    sampleT* a = p->coeffs+p->numb;
+    sampleT* b = p->coeffs+1;
+    sampleT  b0 = p->coeffs[0];
+
+    sampleT poleSamp, zeroSamp, inSamp;
+
+    updateZCoeffs(p);
+
+    inSamp = *p->in;
+    poleSamp = inSamp;
+    zeroSamp = 0.0;
+
+    /* Filter loop */
+    for (i=0; i<p->ndelay; i++) {
+
+      /* Do poles first */
+      /* Sum of products of a's and delays */
+      if (i<p->numa)
+        poleSamp += -(a[i])*readFilter((FILTER*)p,i+1);
+
+      /* Now do the zeros */
+      if (i<(p->numb-1))
+        zeroSamp += (b[i])*readFilter((FILTER*)p,i+1);
+    }
+
+    *p->out = ((b0)*poleSamp + zeroSamp);
+
+    /* update filter delay line */
+    insertFilter((FILTER*)p, poleSamp);
+    return OK;
+}
+
+/* updateZCoeffs -- nudged-pole coefficient cache
+ *
+ * Converts the stored roots to polar form, nudges their magnitudes and
+ * phases, converts back and re-expands the polynomial into the filter's
+ * a coefficients, but only when the nudge factors differ from those of
+ * the cached coefficients.  Returns nonzero if the coefficients changed.
+ */
+static int updateZCoeffs(ZFILTER* p)
+{
+    fpolar B[MAXPOLES];
+    fcomplex C[MAXPOLES+1];
+
+    sampleT* a = p->coeffs+p->numb;
+    fcomplex *roots = p->roots;
+    sampleT kmagf = *p->kmagf; /* Mag nudge factor */
+    sampleT kphsf = *p->kphsf; /* Phs nudge factor */
+
+    int dim = p->numa;
+
+    if (p->coeffsValid && kmagf==p->lastmagf && kphsf==p->lastphsf)
+      return 0;
+
+    /* Nudge pole magnitudes */
+    complex2polar(roots,B,dim);
+    nudgeMags(B,roots,dim,kmagf);
+    nudgePhases(B,roots,dim,kphsf);
+    polar2complex(B,C,dim);
+    expandPoly(C,a,dim);
+
+    /* C now contains the complex roots of the nudged filter */
+    /* and a contains their associated real coefficients. */
+
+    p->lastmagf = kmagf;
+    p->lastphsf = kphsf;
+    p->coeffsValid = 1;
+    return 1;
+}
+
+/* Filter bank initialization routine */
+int ifilterbank(FILTERBANK* p)
+{
+    if ((p->numb<1) || (p->numb>(MAXZEROS+1)) ||
+    (p->numa<0) || (p->numa>MAXPOLES)){
+      fprintf(stderr, "Filter order out of bounds: (1 <= nb(%d) < 51, 0 <= na(%d) <= 50)", p->numb, p->numa);
+      return 0;
+    }
+    if ((p->lanes<1) || (p->lanes>MAXLANES)){
+      fprintf(stderr, "Filter bank lanes out of bounds: (1 <= lanes(%d) <= %d)", p->lanes, MAXLANES);
+      return 0;
+    }
+
+    p->ndelay = MAX(p->numb-1,p->numa);
+    p->delay = (sampleT*) calloc(MAX(p->ndelay,1)*p->lanes, sizeof(sampleT));
+    p->currPos = 0;
+    if (p->delay == NULL)
+      return 0;
+
+    return OK;
+}
+
+void free_filterbank(FILTERBANK* p){
+  if(p->delay!=NULL){
+    free(p->delay);
+  }
+  free(p);
+}
+
+/* afilterbankLanes -- lane-parallel a-rate filter
+ *
+ * The same difference equation and order of operations as afilter,
+ * applied to every lane.  Called with a constant lane count so that
+ * the compiler can turn the lane loops into straight vector code.
+ */
+static inline void afilterbankLanes(FILTERBANK* p, uint32_t nsmps, const int lanes)
+{
+    int      i, l;
+    uint32_t n;
+
+    sampleT* a = p->coeffs+p->numb;
+    sampleT* b = p->coeffs+1;
+    sampleT  b0 = p->coeffs[0];
+
+    sampleT poleSamp[MAXLANES], zeroSamp[MAXLANES];
+    const sampleT *inSamp, *d;
+    sampleT *outSamp;
+    int pos = p->currPos;
+
+    for (n=0; n<nsmps; n++) {
+
+      inSamp = p->in + (size_t)n*lanes;
+      for (l=0; l<lanes; l++) {
+        poleSamp[l] = inSamp[l];
+        zeroSamp[l] = 0.0;
+      }
+
+      /* Inner filter loop, walking back through the delay line */
+      for (i=0; i< p->ndelay; i++) {
+        int k = pos - (i+1);
+        if (k < 0) k += p->ndelay;
+        d = p->delay + (size_t)k*lanes;
+
+        /* Do poles first */
+        if (i<p->numa)
+          for (l=0; l<lanes; l++)
+            poleSamp[l] += -(a[i])*d[l];
+
+        /* Now do the zeros */
+        if (i<(p->numb-1))
+          for (l=0; l<lanes; l++)
+            zeroSamp[l] += (b[i])*d[l];
+      }
+
+      outSamp = p->out + (size_t)n*lanes;
+      for (l=0; l<lanes; l++)
+        outSamp[l] = (b0)*poleSamp[l] + zeroSamp[l];
+
+      /* update filter delay line */
+      if (p->ndelay) {
+        sampleT *slot = p->delay + (size_t)pos*lanes;
+        for (l=0; l<lanes; l++)
+          slot[l] = poleSamp[l];
+        if (++pos == p->ndelay) pos = 0;
+      }
+    }
+    p->currPos = pos;
+}
+
+/* a-rate filter bank routine
+ *
+ * Filters p->lanes independent signals of nsmps samples each.
+ * Each lane's output is identical to running afilter on that lane alone.
+ */
+int afilterbank(FILTERBANK* p, uint32_t nsmps)
+{
+    switch (p->lanes) {
+    case 4:  afilterbankLanes(p, nsmps, 4); break;
+    case 8:  afilterbankLanes(p, nsmps, 8); break;
+    case 16: afilterbankLanes(p, nsmps, 16); break;
+    default: afilterbankLanes(p, nsmps, p->lanes); break;
     }
     return OK;
 }
@@ -71,16 +71,52 @@ typedef struct {
   sampleT* currPos;  /* delay-line current position pointer */ /* >>Was float<< */
   int   ndelay;      /* length of delay line (i.e. filter order) */
   fcomplex* roots;       /* pole roots memory for zfilter */
+
+  /* Members below are not shared with FILTER */
+  sampleT lastmagf, lastphsf; /* nudge factors that produced the current a coefficients */
+  int   coeffsValid;     /* nonzero once lastmagf/lastphsf describe coeffs */
+  int   interpolate;     /* nonzero: ramp a coefficients across a block when the nudge factors change
+                            (0 after izfilter(); set it afterwards to opt in) */
 } ZFILTER;
 
+/* Structure for FILTERBANK: one FILTER's coefficients applied to
+ * several independent signals at once.  Signals are lane-interleaved,
+ * sample n of lane l being at in[n*lanes + l], and the delay line is
+ * laid out the same way, so that each pass over the lanes advances
+ * every signal by one sample with a single vector operation.
+ */
+#define MAXLANES 16
+
+typedef struct {
+  sampleT *out;       /* output signals, lane-interleaved */
+  sampleT *in;        /* input signals, lane-interleaved */
+  sampleT coeffs[MAXPOLES+MAXZEROS+1]; /* filter coefficients, as for FILTER */
+
+  int numa;         /* i-var p-time storage registers */
+  int numb;
+  int lanes;        /* number of signals: 4, 8 or 16 vectorise best */
+
+  sampleT* delay;   /* delay-line state, ndelay*lanes, lane-interleaved */
+  int   currPos;    /* delay-line current slot */
+  int   ndelay;     /* length of delay line (i.e. filter order) */
+} FILTERBANK;
+
 /* API */
 int ifilter(FILTER* p);
 void free_filter(FILTER* p);
 int izfilter(ZFILTER *p);
 void free_zfilter(ZFILTER* p);
 int afilter(FILTER* p, uint32_t nsmps);
+int arfilter(FILTER* p, uint32_t nsmps);
+int apfilter(FILTER* p, uint32_t nsmps, int dir);
+int adfilter(FILTER* p, uint32_t nsmps, uint32_t factor, sampleT* state);
+sampleT afilterout(const sampleT* coeffs, int numb, const sampleT* w);
 int azfilter(ZFILTER* p, uint32_t nsmps);
 int kfilter(FILTER* p);
+int kzfilter(ZFILTER* p);
+int ifilterbank(FILTERBANK* p);
+void free_filterbank(FILTERBANK* p);
+int afilterbank(FILTERBANK* p, uint32_t nsmps);
 
 #endif
 